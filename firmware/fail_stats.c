@@ -0,0 +1,126 @@
+// Failure statistics in flash
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/flash.h"
+#include "hardware/flash.h"
+#include "fail_stats.h"
+
+// The counters live in the last sector of flash. A snapshot of all of them
+// comes first, then a log with one 16-bit entry (chip << 8 | phase) per
+// recorded fail. Recording a fail only programs the next log entry, and the
+// sector is erased only when the log is full and a new snapshot goes in.
+#define FAIL_STATS_OFFSET (PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE)
+#define FAIL_STATS_MAGIC 0x31545346 // "FST1", change when the layout does
+#define FAIL_STATS_EMPTY 0xffff
+#define FAIL_STATS_TIMEOUT_MS 100
+
+typedef struct {
+    uint32_t magic;
+    uint32_t reserved;
+    uint16_t count[FAIL_STATS_CHIPS][FAIL_STATS_PHASES];
+} fail_snapshot_t;
+
+#define FAIL_SNAP_BYTES ((sizeof(fail_snapshot_t) + FLASH_PAGE_SIZE - 1) & ~(FLASH_PAGE_SIZE - 1))
+#define FAIL_LOG_ENTRIES ((FLASH_SECTOR_SIZE - FAIL_SNAP_BYTES) / 2)
+
+static fail_snapshot_t fail_stats;
+static uint fail_log_next; // First free log entry
+
+// Staging for the flash writes, which run with the other core locked out
+static uint8_t fail_buf[FAIL_SNAP_BYTES];
+static uint32_t fail_buf_offset;
+
+static inline const uint8_t *fail_flash()
+{
+    return (const uint8_t *)(XIP_BASE + FAIL_STATS_OFFSET);
+}
+
+static void fail_stats_count(uint16_t entry)
+{
+    uint chip = entry >> 8;
+    uint phase = entry & 0xff;
+
+    if ((chip >= FAIL_STATS_CHIPS) || (phase >= FAIL_STATS_PHASES)) return;
+    if (fail_stats.count[chip][phase] < UINT16_MAX) fail_stats.count[chip][phase]++;
+}
+
+// Reads the counters back from flash. Call once at start up.
+void fail_stats_load()
+{
+    const uint16_t *log = (const uint16_t *)(fail_flash() + FAIL_SNAP_BYTES);
+
+    memcpy(&fail_stats, fail_flash(), sizeof(fail_stats));
+    if (fail_stats.magic != FAIL_STATS_MAGIC) {
+        // Blank, or another layout. The first fail writes a fresh snapshot.
+        memset(&fail_stats, 0, sizeof(fail_stats));
+        fail_log_next = FAIL_LOG_ENTRIES;
+        return;
+    }
+    for (fail_log_next = 0; fail_log_next < FAIL_LOG_ENTRIES; fail_log_next++) {
+        if (log[fail_log_next] == FAIL_STATS_EMPTY) break;
+        fail_stats_count(log[fail_log_next]);
+    }
+}
+
+// Programs one page. Bytes left at 0xff don't change what is already there.
+static void fail_stats_program(void *param)
+{
+    flash_range_program(FAIL_STATS_OFFSET + fail_buf_offset, fail_buf, FLASH_PAGE_SIZE);
+}
+
+static void fail_stats_rewrite(void *param)
+{
+    flash_range_erase(FAIL_STATS_OFFSET, FLASH_SECTOR_SIZE);
+    flash_range_program(FAIL_STATS_OFFSET, fail_buf, FAIL_SNAP_BYTES);
+}
+
+// Counts a fail and saves it. Call from core0 while core1 is idle.
+void fail_stats_record(uint chip, uint phase)
+{
+    uint16_t entry = (chip << 8) | phase;
+    uint32_t off;
+    int rc;
+
+    if ((chip >= FAIL_STATS_CHIPS) || (phase >= FAIL_STATS_PHASES)) return;
+    fail_stats_count(entry);
+
+    if (fail_log_next < FAIL_LOG_ENTRIES) {
+        off = FAIL_SNAP_BYTES + fail_log_next * 2;
+        memset(fail_buf, 0xff, FLASH_PAGE_SIZE);
+        memcpy(fail_buf + (off & (FLASH_PAGE_SIZE - 1)), &entry, 2);
+        fail_buf_offset = off & ~(FLASH_PAGE_SIZE - 1);
+        rc = flash_safe_execute(fail_stats_program, NULL, FAIL_STATS_TIMEOUT_MS);
+        if (rc == PICO_OK) fail_log_next++;
+    } else {
+        // Log is full. Fold it into a new snapshot.
+        fail_stats.magic = FAIL_STATS_MAGIC;
+        memset(fail_buf, 0xff, sizeof(fail_buf));
+        memcpy(fail_buf, &fail_stats, sizeof(fail_stats));
+        rc = flash_safe_execute(fail_stats_rewrite, NULL, FAIL_STATS_TIMEOUT_MS);
+        if (rc == PICO_OK) fail_log_next = 0;
+    }
+    if (rc != PICO_OK) printf("Fail stats not saved (%d)\n", rc);
+}
+
+uint32_t fail_stats_get(uint chip, uint phase)
+{
+    if ((chip >= FAIL_STATS_CHIPS) || (phase >= FAIL_STATS_PHASES)) return 0;
+    return fail_stats.count[chip][phase];
+}
+
+// Dumps the counts for one chip type over stdio
+void fail_stats_report(uint chip, const char *chip_name, const char *const *phase_names,
+                       uint phases)
+{
+    uint phase;
+
+    printf("First failing phase, %s:", chip_name);
+    for (phase = 0; (phase < phases) && (phase < FAIL_STATS_PHASES); phase++) {
+        if (fail_stats_get(chip, phase)) {
+            printf(" %s %lu", phase_names[phase], (unsigned long)fail_stats_get(chip, phase));
+        }
+    }
+    printf("\n");
+}
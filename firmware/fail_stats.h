@@ -0,0 +1,18 @@
+#ifndef FAIL_STATS_H
+#define FAIL_STATS_H
+
+// Failure statistics. Counts which test phase first caught a bad chip, for
+// each chip type, and keeps the counts in the last sector of flash so they
+// survive power cycles. The pass/fail profiles run the phases that catch a
+// chip type most often first, so a bad chip gets its verdict sooner.
+
+#define FAIL_STATS_CHIPS 16
+#define FAIL_STATS_PHASES 16
+
+void fail_stats_load();
+void fail_stats_record(uint chip, uint phase);
+uint32_t fail_stats_get(uint chip, uint phase);
+void fail_stats_report(uint chip, const char *chip_name, const char *const *phase_names,
+                       uint phases);
+
+#endif
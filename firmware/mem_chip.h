@@ -1,18 +1,65 @@
 #ifndef MEMCHIP_H
 #define MEMCHIP_H
 
+// GPIO wired to the first socket pin. The chip programs, the cycle player
+// and q_pins all count from here.
+#define SOCKET_PIN_BASE 5
+
 typedef struct {
     uint8_t num_variants;
     const char *variant_names[];
 } mem_chip_variants_t;
 
+// Describes how the socket pins look to the cycle player (ram_cycle.pio),
+// which drives raw RAS/CAS/WE sequences the test programs can't express.
+// Bit n of a vector drives socket pin out_base + n.
+typedef struct {
+    uint8_t out_base;    // First socket pin the player drives
+    uint8_t out_count;
+    uint8_t addr_shift;  // Vector bit that carries A0
+    uint8_t banks;       // 2 if the low row index bit picks RAS1#/RAS2#
+    uint16_t idle;       // All strobes inactive
+    uint16_t ras[2];     // RAS# for each bank
+    uint16_t cas[2];     // CAS# for each bank
+    uint16_t we;
+} ram_cycle_map_t;
+
+// Where the read path samples Q, for measuring access times. Cycle counts
+// are between the instructions that drive one edge and the next, leaving
+// out delays. The patched delays of the fields named are added on top.
+typedef struct {
+    uint8_t rcd_field;    // Delay field for tRCD
+    uint8_t ras_cycles;   // RAS# low to CAS# low
+    uint8_t cas_cycles;   // CAS# low to the sample
+    uint32_t cas_fields;  // Delay fields between CAS# low and the sample
+    uint8_t sample_field; // The wait between the address release and the sample
+} ram_sample_t;
+
+// Optional chip features (mem_chip_t.caps)
+#define MEM_CAP_CBR 0x01   // CAS-before-RAS refresh with an internal row counter
+#define MEM_CAP_PAGE 0x02  // Program keeps RAS# low between accesses on request
+#define MEM_CAP_HALF 0x04  // Half-good part, the variants pick the good half
+
 typedef struct {
     void (*setup_pio)(uint speed_grade, uint variant);
     void (*teardown_pio)();
     int (*ram_read)(int addr);
     void (*ram_write)(int addr, int data);
+    // Nibble mode, four bits per RAS# cycle starting at addr. Bit n of the
+    // data is the nth bit in the chip's nibble order. Only valid for the
+    // variants in nibble_variants.
+    int (*ram_read_nibble)(int addr);
+    void (*ram_write_nibble)(int addr, int data);
+    uint8_t nibble_variants;
     uint32_t mem_size;
     uint32_t bits;
+    uint32_t q_pins;    // Socket pins Q (or DQ0 and up) come in on
+    uint8_t row_bits;  // Low address bits that pick the row (and bank, if any)
+    uint16_t row_fixed; // Row address lines the wiring holds high (half parts)
+    uint8_t refresh_ms; // Refresh period from the data sheet
+    const ram_cycle_map_t *cycle_map;
+    uint8_t caps;
+    const ram_sample_t *sample; // NULL if the access time can't be measured
     const mem_chip_variants_t *variants;
     uint8_t speed_grades;
     const char *chip_name;
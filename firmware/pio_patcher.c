@@ -6,10 +6,12 @@
 
 uint16_t current_pio_instructions[32];
 struct pio_program current_pio_program;
+static const struct pio_program *current_pio_source;
 
 // Copies a const pio program over to our internal buffer
 void set_current_pio_program(const struct pio_program *prog)
 {
+    current_pio_source = prog;
     memcpy(current_pio_instructions, prog->instructions, prog->length * sizeof(uint16_t));
     current_pio_program.instructions = current_pio_instructions;
     current_pio_program.length = prog->length;
@@ -32,7 +34,7 @@ void pio_patch_delays(const uint8_t *delays, uint8_t length)
     uint8_t field;
     uint16_t instr;
 
-    for (i = 0; i < 31; i++) {
+    for (i = 0; i < current_pio_program.length; i++) {
         field = (current_pio_instructions[i] >> 8) & 0x1f;
         // 0 is reserved for instructions that don't use this feature
         if ((field > 0) && (field < length)) {
@@ -42,3 +44,63 @@ void pio_patch_delays(const uint8_t *delays, uint8_t length)
         }
     }
 }
+
+// Takes up to trim cycles off the delays that were patched in from the
+// given field, in the copy of the program loaded at off. Trim 0 puts the
+// patched delays back. The state machine must be stalled while we write.
+// Returns the number of cycles we could take off, 0 if no instruction
+// uses the field.
+uint8_t pio_trim_delays(PIO p, uint off, uint8_t field, uint8_t trim)
+{
+    uint8_t i;
+    uint8_t delay;
+    uint8_t cut = trim;
+    bool found = false;
+    uint16_t instr;
+
+    for (i = 0; i < current_pio_program.length; i++) {
+        if (((current_pio_source->instructions[i] >> 8) & 0x1f) != field) continue;
+        delay = (current_pio_instructions[i] >> 8) & 0x1f;
+        if (delay < cut) cut = delay;
+        found = true;
+    }
+    if (!found) return 0;
+    for (i = 0; i < current_pio_program.length; i++) {
+        if (((current_pio_source->instructions[i] >> 8) & 0x1f) != field) continue;
+        delay = (current_pio_instructions[i] >> 8) & 0x1f;
+        instr = (current_pio_instructions[i] & 0xe0ff) | ((delay - cut) << 8);
+        // JMP targets are relocated when a program is loaded
+        if ((instr & 0xe000) == 0) instr += off;
+        p->instr_mem[off + i] = instr;
+    }
+    return cut;
+}
+
+// Delay patched in for the given field, 0 if no instruction uses it
+uint8_t pio_field_delay(uint8_t field)
+{
+    uint8_t i;
+
+    for (i = 0; i < current_pio_program.length; i++) {
+        if (((current_pio_source->instructions[i] >> 8) & 0x1f) == field) {
+            return (current_pio_instructions[i] >> 8) & 0x1f;
+        }
+    }
+    return 0;
+}
+
+// Loads a new delay into the instructions that were patched from the given
+// field, in the copy of the program loaded at off. The state machine must
+// be stalled while we write. pio_trim_delays with trim 0 undoes it.
+void pio_set_delays(PIO p, uint off, uint8_t field, uint8_t delay)
+{
+    uint8_t i;
+    uint16_t instr;
+
+    for (i = 0; i < current_pio_program.length; i++) {
+        if (((current_pio_source->instructions[i] >> 8) & 0x1f) != field) continue;
+        instr = (current_pio_instructions[i] & 0xe0ff) | ((delay & 0x1f) << 8);
+        if ((instr & 0xe000) == 0) instr += off;
+        p->instr_mem[off + i] = instr;
+    }
+}
@@ -4,6 +4,9 @@
 void set_current_pio_program(const struct pio_program *prog);
 struct pio_program *get_current_pio_program();
 void pio_patch_delays(const uint8_t *delays, uint8_t length);
+uint8_t pio_trim_delays(PIO p, uint off, uint8_t field, uint8_t trim);
+uint8_t pio_field_delay(uint8_t field);
+void pio_set_delays(PIO p, uint off, uint8_t field, uint8_t delay);
 
 
 
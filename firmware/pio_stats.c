@@ -0,0 +1,119 @@
+// PIO FIFO stall telemetry
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/pio.h"
+#include "hardware/clocks.h"
+#include "pio_stats.h"
+
+static pio_stats_t pio_stats[PIO_STATS_PHASES][PIO_STATS_ELEMENTS];
+static pio_stats_t pio_stats_idle; // Collects samples taken outside of an element
+static uint32_t pio_stats_start;
+
+pio_stats_t *pio_stats_cur = &pio_stats_idle;
+PIO pio_stats_pio;
+uint pio_stats_sm;
+
+// Clears all counters and selects the state machine to watch
+void pio_stats_reset(PIO p, uint s)
+{
+    memset(pio_stats, 0, sizeof(pio_stats));
+    memset(&pio_stats_idle, 0, sizeof(pio_stats_idle));
+    pio_stats_cur = &pio_stats_idle;
+    // Free running SysTick on the processor clock for the access timing
+    systick_hw->csr = 0;
+    systick_hw->rvr = 0xffffff;
+    systick_hw->cvr = 0;
+    systick_hw->csr = 0x5;
+    pio_stats_pio = p;
+    pio_stats_sm = s;
+}
+
+// Starts accumulating into the given test phase and element
+void pio_stats_begin(uint phase, uint element)
+{
+    if (phase >= PIO_STATS_PHASES) phase = PIO_STATS_PHASES - 1;
+    if (element >= PIO_STATS_ELEMENTS) element = PIO_STATS_ELEMENTS - 1;
+    pio_stats_cur = &pio_stats[phase][element];
+    // Throw away anything that was flagged before this element began
+    pio_stats_pio->fdebug = (1u << (PIO_FDEBUG_TXSTALL_LSB + pio_stats_sm)) |
+                            (1u << (PIO_FDEBUG_RXSTALL_LSB + pio_stats_sm)) |
+                            (1u << (PIO_FDEBUG_TXOVER_LSB + pio_stats_sm));
+    pio_stats_start = time_us_32();
+}
+
+void pio_stats_end()
+{
+    pio_stats_cur->time_us += time_us_32() - pio_stats_start;
+    pio_stats_cur->runs++;
+    pio_stats_cur = &pio_stats_idle;
+}
+
+const pio_stats_t *pio_stats_get(uint phase, uint element)
+{
+    if ((phase >= PIO_STATS_PHASES) || (element >= PIO_STATS_ELEMENTS)) return NULL;
+    return &pio_stats[phase][element];
+}
+
+// Total time spent in all elements of a phase
+uint32_t pio_stats_phase_time(uint phase)
+{
+    uint32_t total = 0;
+    uint el;
+    if (phase >= PIO_STATS_PHASES) return 0;
+    for (el = 0; el < PIO_STATS_ELEMENTS; el++) {
+        total += pio_stats[phase][el].time_us;
+    }
+    return total;
+}
+
+// Share of the element's wall time the SM spent running accesses, in
+// percent, from the average timed access and the access count
+static uint32_t pio_stats_busy(const pio_stats_t *st)
+{
+    uint64_t busy, wall;
+    if ((st->timed == 0) || (st->time_us == 0)) return 0;
+    busy = (uint64_t)st->busy_cycles * st->accesses / st->timed;
+    wall = (uint64_t)st->time_us * (clock_get_hz(clk_sys) / 1000000);
+    busy = busy * 100 / wall;
+    return (busy > 100) ? 100 : (uint32_t)busy;
+}
+
+// A phase is DRAM bound if the SM was busy most of the time. Otherwise
+// it sat waiting for the CPU to hand it the next access.
+static const char *pio_stats_bound(const pio_stats_t *st)
+{
+    if (st->timed == 0) return "-";
+    return (pio_stats_busy(st) * 2 >= 100) ? "DRAM" : "CPU";
+}
+
+// Dumps the counters over stdio
+void pio_stats_report(const char *const *phase_names, uint phases)
+{
+    uint phase, el;
+    const pio_stats_t *st;
+
+    printf("PIO FIFO telemetry\n");
+    printf("%-10s el %10s %8s %7s %6s %6s %7s %7s %6s %5s bound\n", "phase", "time_us",
+           "samples", "txempty", "txlvl", "rxlvl", "txstall", "rxstall", "txover", "busy%");
+    for (phase = 0; (phase < phases) && (phase < PIO_STATS_PHASES); phase++) {
+        for (el = 0; el < PIO_STATS_ELEMENTS; el++) {
+            st = &pio_stats[phase][el];
+            if (st->runs == 0) continue;
+            // FIFO levels are shown as averages in tenths of an entry
+            printf("%-10s %2d %10lu %8lu %7lu %6lu %6lu %7lu %7lu %6lu %5lu %s\n",
+                   phase_names[phase], el, (unsigned long)st->time_us,
+                   (unsigned long)st->samples, (unsigned long)st->tx_empty,
+                   (unsigned long)(st->samples ? st->tx_level * 10 / st->samples : 0),
+                   (unsigned long)(st->samples ? st->rx_level * 10 / st->samples : 0),
+                   (unsigned long)st->tx_stall, (unsigned long)st->rx_stall,
+                   (unsigned long)st->tx_over, (unsigned long)pio_stats_busy(st),
+                   pio_stats_bound(st));
+        }
+        if (pio_stats_phase_time(phase)) {
+            printf("%-10s total %lu us\n", phase_names[phase],
+                   (unsigned long)pio_stats_phase_time(phase));
+        }
+    }
+}
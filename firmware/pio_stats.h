@@ -0,0 +1,96 @@
+#ifndef PIO_STATS_H
+#define PIO_STATS_H
+
+// PIO FIFO telemetry. Samples the FDEBUG stall flags and the FIFO levels
+// of the RAM state machine while a test runs, so we can tell whether a
+// phase is waiting on the CPU (TX FIFO starved) or on the DRAM (SM busy).
+
+#include "hardware/structs/systick.h"
+
+// Set to 0 to compile the telemetry out of the test loops
+#ifndef PIO_STATS_ENABLE
+#define PIO_STATS_ENABLE 1
+#endif
+
+#define PIO_STATS_PHASES 16
+#define PIO_STATS_ELEMENTS 8
+
+// The test loops sample once every (mask + 1) accesses
+#define PIO_STATS_SAMPLE_MASK 0x3f
+
+typedef struct {
+    uint32_t time_us;  // Total time spent in this element
+    uint32_t runs;     // Number of times the element was entered
+    uint32_t samples;
+    uint32_t tx_empty; // Samples that found the TX FIFO empty
+    uint32_t tx_level; // Sum of TX FIFO levels over all samples
+    uint32_t rx_level; // Sum of RX FIFO levels over all samples
+    uint32_t tx_stall; // Samples where the SM had stalled on an empty TX FIFO
+    uint32_t rx_stall; // Samples where the SM had stalled on a full RX FIFO
+    uint32_t tx_over;  // Samples where the CPU had written to a full TX FIFO
+    uint32_t accesses; // Reads and writes issued
+    uint32_t timed;    // Accesses that were timed, one in every (mask + 1)
+    uint32_t busy_cycles; // CPU cycles from put to result, over the timed accesses
+} pio_stats_t;
+
+extern pio_stats_t *pio_stats_cur;
+extern PIO pio_stats_pio;
+extern uint pio_stats_sm;
+
+void pio_stats_reset(PIO p, uint s);
+void pio_stats_begin(uint phase, uint element);
+void pio_stats_end();
+const pio_stats_t *pio_stats_get(uint phase, uint element);
+uint32_t pio_stats_phase_time(uint phase);
+void pio_stats_report(const char *const *phase_names, uint phases);
+
+// Access timing. The chip routines wait for their result, so the SM
+// stalls on its pull after every access whatever the bottleneck, and the
+// stall flags can't tell who is waiting on whom. Timing one access in
+// every (mask + 1) from put to result gives how long the SM is busy per
+// access, and with the access count, the share of wall time it was busy.
+// SysTick counts CPU cycles down from 2^24, on the core that reset us.
+static inline bool pio_stats_time_next()
+{
+#if PIO_STATS_ENABLE
+    return (pio_stats_cur->accesses++ & PIO_STATS_SAMPLE_MASK) == 0;
+#else
+    return false;
+#endif
+}
+
+static inline uint32_t pio_stats_stamp()
+{
+    return systick_hw->cvr;
+}
+
+static inline void pio_stats_timed(uint32_t stamp)
+{
+    pio_stats_cur->busy_cycles += (stamp - systick_hw->cvr) & 0xffffff;
+    pio_stats_cur->timed++;
+}
+
+// Takes one sample of the FIFO state. Cheap enough to live in the test loops.
+static inline void pio_stats_sample()
+{
+#if PIO_STATS_ENABLE
+    pio_stats_t *st = pio_stats_cur;
+    uint32_t dbg = pio_stats_pio->fdebug;
+    uint tx = pio_sm_get_tx_fifo_level(pio_stats_pio, pio_stats_sm);
+
+    st->samples++;
+    st->tx_level += tx;
+    st->rx_level += pio_sm_get_rx_fifo_level(pio_stats_pio, pio_stats_sm);
+    if (tx == 0) st->tx_empty++;
+    st->tx_stall += (dbg >> (PIO_FDEBUG_TXSTALL_LSB + pio_stats_sm)) & 1;
+    st->rx_stall += (dbg >> (PIO_FDEBUG_RXSTALL_LSB + pio_stats_sm)) & 1;
+    st->tx_over += (dbg >> (PIO_FDEBUG_TXOVER_LSB + pio_stats_sm)) & 1;
+
+    // The flags are sticky, so clear ours for the next interval
+    pio_stats_pio->fdebug = dbg & ((1u << (PIO_FDEBUG_TXSTALL_LSB + pio_stats_sm)) |
+                                   (1u << (PIO_FDEBUG_RXSTALL_LSB + pio_stats_sm)) |
+                                   (1u << (PIO_FDEBUG_TXOVER_LSB + pio_stats_sm)));
+#endif
+}
+
+#endif
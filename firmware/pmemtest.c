@@ -6,18 +6,27 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include "pico/stdlib.h"
 #include "pico/multicore.h"
+#include "pico/flash.h"
 #include "pico/util/queue.h"
 #include "hardware/pio.h"
 #include "hardware/vreg.h"
+#include "hardware/sync.h"
 #include "pio_patcher.h"
 #include "mem_chip.h"
 #include "xoroshiro64starstar.h"
+#include "pio_stats.h"
+#include "fail_stats.h"
+#include "trace.h"
+#include "test_status.h"
 
 PIO pio;
 uint sm = 0;
 uint offset; // Returns offset of starting instruction
+uint32_t ram_page_hold; // Set to keep RAS# low after the next access (fast page mode)
 
 // Defined RAM pio programs
 #include "ram4116.pio.h"
@@ -26,6 +35,7 @@ uint offset; // Returns offset of starting instruction
 #include "ram41128.pio.h"
 #include "ram41256.pio.h"
 #include "ram_4bit.pio.h"
+#include "ram_cycle.pio.h"
 
 #include "st7789.h"
 
@@ -40,6 +50,7 @@ uint offset; // Returns offset of starting instruction
 #include "drum_icon3.h"
 
 #include "gui.h"
+#include "sserif13.h"
 
 
 #define GPIO_POWER 4
@@ -49,16 +60,17 @@ uint offset; // Returns offset of starting instruction
 #define GPIO_BACK_BTN 28
 #define GPIO_LED 25
 
-// Status shared variables between cores
-// Not really thread safe but this
-// status is unimportant.
-volatile int stat_cur_addr;
-volatile int stat_old_addr;
-volatile int stat_cur_bit;
-queue_t stat_cur_test;
-volatile int stat_cur_subtest;
+// Progress channel from core1 to core0 (see test_status.h)
+status_channel_t status_chan;
+// Core1's working copy of its progress
+static test_status_t status;
+// Core0's view of the progress
+static int stat_old_addr;
+static int stat_shown_test;
+static uint32_t stat_shown_runs;
 
 static uint ram_bit_mask;
+static uint ram_word_mask;
 
 gui_listbox_t *cur_menu;
 
@@ -75,17 +87,30 @@ const mem_chip_t *chip_list[] = {&ram4027_chip, &ram4116_half_chip, &ram4116_chi
 gui_listbox_t variants_menu = {7, 40, 220, 0, 4, 0, 0, 0};
 gui_listbox_t speed_menu = {7, 40, 220, 0, 4, 0, 0, 0};
 
+#define MODE_QUICK 0
+#define MODE_STANDARD 1
+#define MODE_EXHAUSTIVE 2
+#define MODE_RETENTION 3
+#define MODE_ACCESS 4
+#define MODE_SOAK 5
+#define NUM_MODES 6
+char *mode_menu_items[NUM_MODES] = {"Quick", "Standard", "Exhaustive", "Retention", "Access Time",
+                                    "Soak"};
+gui_listbox_t mode_menu = {7, 40, 220, NUM_MODES, 4, 0, 0, mode_menu_items};
+
 
 typedef enum {
     MAIN_MENU,
     VARIANT_MENU,
     SPEED_MENU,
+    MODE_MENU,
     DO_SOCKET,
     DO_TEST,
     TEST_RESULTS
 } gui_state_t;
 
 gui_state_t gui_state = MAIN_MENU;
+static bool chip_auto; // Identify the chip before each run
 
 void setup_main_menu()
 {
@@ -93,7 +118,9 @@ void setup_main_menu()
     for (i = 0; i < NUM_CHIPS; i++) {
         main_menu_items[i] = (char *)chip_list[i]->chip_name;
     }
-    main_menu.tot_lines = NUM_CHIPS;
+    // The entry past the chips identifies the chip in the socket
+    main_menu_items[NUM_CHIPS] = "Auto (4164/41256/x4)";
+    main_menu.tot_lines = NUM_CHIPS + 1;
 }
 
 // Function queue entry for dispatching worker functions
@@ -107,9 +134,166 @@ typedef struct
 queue_t call_queue;
 queue_t results_queue;
 
+#define TEST_MAX_PHASES 16
+
+// What a job reports back to core0. Core1 fills in a single static copy
+// while the job runs and the results queue hands core0 its own copy, so
+// nothing is allocated on the way out.
+typedef struct
+{
+    uint32_t fail_mask;  // Failing bits, 0 on a pass or JOB_ABORTED
+    int8_t phase;        // Test that saw the first failure, -1 if none
+    int8_t element;      // March element or pattern group within that test
+    int8_t bit;          // Bit under test, where the test walks the bits
+    uint32_t addr;       // First failing address
+    uint32_t row;
+    uint32_t col;
+    uint32_t expected;   // Data we wanted at the first failing address
+    uint32_t actual;     // Data we got back
+    uint32_t fail_count; // Failing reads seen before the job gave up
+    uint64_t seed;       // Generator seed in use, 0 for fixed patterns
+    uint32_t refresh_rows; // RAS-only refreshes the scheduler had to add
+    uint32_t phase_us[TEST_MAX_PHASES];
+} test_result_t;
+
+static test_result_t test_result;
+static uint64_t cur_seed;
+static uint32_t phase_start;
+
+// Returned in place of the job result when the job was cancelled
+#define JOB_ABORTED 0x80000000
+
+// Set by core0 to ask the running job to stop. Core1 polls it at its
+// progress points, which are a few hundred accesses apart.
+static volatile bool job_cancel;
+// Set on core1 once the running job has seen the request, so a job that
+// had already finished when Back was pressed keeps its result
+static bool job_stopped;
+
+static inline bool job_cancelled()
+{
+    if (job_cancel) job_stopped = true;
+    return job_stopped;
+}
+
+// Hands a job to core1. Only call this while core1 is idle.
+void job_dispatch(uint32_t (*func)(uint32_t, uint32_t), uint32_t data, uint32_t data2)
+{
+    queue_entry_t entry = {func, data, data2};
+    job_cancel = false;
+    queue_add_blocking(&call_queue, &entry);
+}
+
+// Asks core1 to abandon the running job. The job still reports back
+// through the results queue, with JOB_ABORTED as its result.
+void job_request_cancel()
+{
+    job_cancel = true;
+}
+
+// Refresh scheduler. Some tests leave rows alone for longer than the chip
+// can hold them, which makes the result depend on the test order rather
+// than the chip. Every access marks its row, and every half period any row
+// that wasn't marked gets a RAS-only refresh, so no row goes longer than
+// one period without being opened.
+#ifndef REFRESH_SCHED_ENABLE
+#define REFRESH_SCHED_ENABLE 1
+#endif
+
+// Overrides the data sheet refresh period when set
+#ifndef REFRESH_SCHED_PERIOD_US
+#define REFRESH_SCHED_PERIOD_US 0
+#endif
+
+#define REFRESH_MAX_ROWS 512
+
+static uint32_t refresh_touched[REFRESH_MAX_ROWS / 32];
+static uint32_t refresh_period_us;  // 0 while the scheduler is off
+static uint32_t refresh_window_at;
+static uint refresh_rows;
+static uint32_t refresh_injected;   // Rows we had to refresh ourselves
+
+static inline void refresh_mark(int addr)
+{
+#if REFRESH_SCHED_ENABLE
+    uint row = addr & (refresh_rows - 1);
+    refresh_touched[row >> 5] |= 1u << (row & 31);
+#endif
+}
+
+// Starts the scheduler with the given period, or stops it if 0. The
+// retention tests turn it off, since refreshing is exactly what they avoid.
+static void refresh_sched_start(uint32_t period_us)
+{
+    refresh_rows = 1 << chip_list[main_menu.sel_line]->row_bits;
+    if (period_us && REFRESH_SCHED_PERIOD_US) period_us = REFRESH_SCHED_PERIOD_US;
+    refresh_period_us = period_us;
+    refresh_window_at = time_us_32();
+    memset(refresh_touched, 0, sizeof(refresh_touched));
+}
+
+// Refreshes whatever rows the test hasn't touched since the last window
+static void refresh_window()
+{
+    uint32_t idle;
+    uint w, b;
+    bool busy = false;
+
+    for (w = 0; w < (refresh_rows + 31) / 32; w++) {
+        idle = ~refresh_touched[w];
+        if (refresh_rows < 32) idle &= (1u << refresh_rows) - 1;
+        refresh_touched[w] = 0;
+        while (idle) {
+            b = __builtin_ctz(idle);
+            idle &= idle - 1;
+            if (!busy) {
+                ram_cycle_begin();
+                busy = true;
+            }
+            ram_cycle_ras_only(w * 32 + b);
+            refresh_injected++;
+        }
+    }
+    if (busy) ram_cycle_end();
+    TRACE(TRACE_REFRESH, TR_REFRESH_INJECT, refresh_injected, 0);
+}
+
+// Checked at the test loops' sample points
+static inline void refresh_tick()
+{
+#if REFRESH_SCHED_ENABLE
+    uint32_t now;
+    if (refresh_period_us == 0) return;
+    now = time_us_32();
+    if ((now - refresh_window_at) >= refresh_period_us / 2) {
+        refresh_window_at = now;
+        refresh_window();
+    }
+#endif
+}
+
+// Adds the time since the last test_begin to the running phase
+static void test_phase_done()
+{
+    if ((status.test >= 0) && (status.test < TEST_MAX_PHASES)) {
+        test_result.phase_us[status.test] += time_us_32() - phase_start;
+    }
+}
+
+// Clears the result record for a new job, or a new soak run
+static void test_result_reset()
+{
+    memset(&test_result, 0, sizeof(test_result));
+    test_result.phase = -1;
+    test_result.element = -1;
+    test_result.bit = -1;
+}
+
 // Entry point for second core. This is just a generic
 // function dispatcher lifted from the Raspberry Pi example code.
 void core1_entry() {
+    // Let core0 park us while it writes the failure statistics to flash
+    flash_safe_execute_core_init();
     while (1) {
         // Function pointer is passed to us via the queue_entry_t which also
         // contains the function parameter.
@@ -119,10 +303,22 @@ void core1_entry() {
         queue_entry_t entry;
 
         queue_remove_blocking(&call_queue, &entry);
-
-        int32_t result = entry.func(entry.data, entry.data2);
-
-        queue_add_blocking(&results_queue, &result);
+        TRACE(TRACE_CORE1, TR_CORE1_START, entry.data, entry.data2);
+
+        test_result_reset();
+        status.test = -1;
+
+        refresh_period_us = 0;
+        refresh_injected = 0;
+        job_stopped = false;
+        uint32_t result = entry.func(entry.data, entry.data2);
+        if (job_stopped) result = JOB_ABORTED;
+        test_phase_done();
+        test_result.fail_mask = result;
+        test_result.refresh_rows = refresh_injected;
+        TRACE(TRACE_CORE1, TR_CORE1_DONE, result, test_result.fail_count);
+
+        queue_add_blocking(&results_queue, &test_result);
     }
 }
 
@@ -142,37 +338,229 @@ static inline void power_off()
 // Wrapper that just calls the read routine for the selected chip
 static inline int ram_read(int addr)
 {
-    return chip_list[main_menu.sel_line]->ram_read(addr);
+    uint32_t stamp;
+    int d;
+
+    refresh_mark(addr);
+    if (!pio_stats_time_next()) return chip_list[main_menu.sel_line]->ram_read(addr);
+    stamp = pio_stats_stamp();
+    d = chip_list[main_menu.sel_line]->ram_read(addr);
+    pio_stats_timed(stamp);
+    return d;
 }
 
 // Wrapper that just calls the write routine for the selected chip
 static inline void ram_write(int addr, int data)
 {
+    uint32_t stamp;
+
+    refresh_mark(addr);
+    if (!pio_stats_time_next()) {
+        chip_list[main_menu.sel_line]->ram_write(addr, data);
+        return;
+    }
+    stamp = pio_stats_stamp();
     chip_list[main_menu.sel_line]->ram_write(addr, data);
+    pio_stats_timed(stamp);
+}
+
+// Called by the test loops for every access. Every so often this takes a
+// telemetry sample, publishes our progress to core0 and checks whether
+// the job was cancelled. Returns false if the test should stop now.
+static inline bool test_progress(int addr)
+{
+    if ((addr & PIO_STATS_SAMPLE_MASK) == 0) {
+        pio_stats_sample();
+        refresh_tick();
+        if ((addr & STATUS_PUBLISH_MASK) == 0) {
+            status.addr = addr;
+            status_publish(&status_chan, &status);
+            return !job_cancelled();
+        }
+    }
+    return true;
+}
+
+// Progress for loops that go a row at a time. Counts the cells done so
+// far, so every row gets a sample point.
+static inline bool test_progress_row(uint32_t addr_size, uint row)
+{
+    return test_progress(row * (addr_size >> chip_list[main_menu.sel_line]->row_bits));
+}
+
+// Switches to the next test and lets core0 know right away
+static void test_begin(int test)
+{
+    test_phase_done();
+    phase_start = time_us_32();
+    cur_seed = 0;
+    status.test = test;
+    status.subtest = 0;
+    status.bit = 0;
+    status.addr = 0;
+    status_publish(&status_chan, &status);
+}
+
+// Soak mode. Runs the standard profile over and over in a single job, so
+// the chip stays powered and the PIO programs stay loaded between runs.
+// A failure doesn't end the run: the march elements carry on past bad
+// reads and the profile goes on to the next phase, so one hard fault
+// can't hide the rest. The other phases still stop at their first bad
+// read. Every bad read goes into a union map of cells with the bits seen
+// wrong and the number of runs the cell failed in. Cells that fail in
+// only some of the runs are the intermittents a single run can miss.
+
+// Runs to do, 0 to keep going until stopped
+#ifndef SOAK_ITERATIONS
+#define SOAK_ITERATIONS 0
+#endif
+
+#define SOAK_CELLS 64
+
+typedef struct {
+    uint32_t addr;
+    uint32_t bits;     // Union of the bits that read back wrong
+    uint32_t hits;     // Runs in which this cell failed
+    uint32_t last_run; // So a cell is only counted once per run
+} soak_cell_t;
+
+typedef struct {
+    uint64_t start_us;
+    volatile uint32_t iterations; // Finished runs. Core0 reads it during the job.
+    uint32_t failed;              // Runs that failed
+    uint32_t fail_mask;           // Union of the failing bits
+    uint32_t last_us;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint32_t phase_fails[TEST_MAX_PHASES]; // Runs in which each phase failed
+    uint32_t run_phases;          // Phases that failed in the current run
+    uint32_t cells;
+    uint32_t cells_lost;          // Bad reads at cells that didn't fit in the map
+    soak_cell_t cell[SOAK_CELLS];
+} soak_report_t;
+
+static soak_report_t soak_report;
+static bool soak_running;
+
+static void soak_add_cell(uint32_t addr, uint32_t bits)
+{
+    soak_report_t *rep = &soak_report;
+    uint i;
+
+    rep->fail_mask |= bits;
+    if ((status.test >= 0) && (status.test < TEST_MAX_PHASES)) rep->run_phases |= 1u << status.test;
+    for (i = 0; i < rep->cells; i++) {
+        if (rep->cell[i].addr == addr) break;
+    }
+    if (i == rep->cells) {
+        if (rep->cells == SOAK_CELLS) {
+            rep->cells_lost++;
+            return;
+        }
+        rep->cells++;
+        rep->cell[i].addr = addr;
+        rep->cell[i].last_run = UINT32_MAX;
+    }
+    rep->cell[i].bits |= bits;
+    if (rep->cell[i].last_run != rep->iterations) {
+        rep->cell[i].last_run = rep->iterations;
+        rep->cell[i].hits++;
+    }
+}
+
+// Records a failing read. Only the first one is kept in detail, after
+// that we just count. Returns false so the caller can bail out, except in
+// soak mode, where the march elements carry on.
+static bool test_fail(int addr, uint32_t expected, uint32_t actual)
+{
+    uint row_bits = chip_list[main_menu.sel_line]->row_bits;
+
+    if (test_result.fail_count++ == 0) {
+        test_result.phase = status.test;
+        test_result.element = status.subtest;
+        test_result.bit = status.bit;
+        test_result.addr = addr;
+        test_result.row = addr & ((1 << row_bits) - 1);
+        test_result.col = addr >> row_bits;
+        test_result.expected = expected;
+        test_result.actual = actual;
+        test_result.seed = cur_seed;
+    }
+    if (soak_running) soak_add_cell(addr, expected ^ actual);
+    return soak_running;
+}
+
+// Data background for the march elements. A cell's 0 is inverted where
+// the parity of its address bits under march_bg_mask is odd. Picking one
+// row and one column bit gives a checkerboard, one of them alone gives
+// stripes and the next bits up give a double checkerboard. 0 is solid.
+#define BG_SOLID 0
+#define BG_CHECKER 1
+#define BG_ROW_STRIPE 2
+#define BG_COL_STRIPE 3
+#define BG_DOUBLE_CHECKER 4
+#define NUM_BACKGROUNDS 5
+
+static uint32_t march_bg_mask;
+
+static inline uint32_t march_bg(int a)
+{
+    return -(uint32_t)__builtin_parity(a & march_bg_mask);
+}
+
+// Sets up a background from the chip's row/column split. On the banked
+// chips the lowest row index bit is the bank, so rows start one bit up.
+static void march_set_background(int bg)
+{
+    const mem_chip_t *chip = chip_list[main_menu.sel_line];
+    uint32_t row = 1u << (chip->cycle_map->banks - 1);
+    uint32_t col = 1u << chip->row_bits;
+
+    switch (bg) {
+        case BG_CHECKER:
+            march_bg_mask = row | col;
+            break;
+        case BG_ROW_STRIPE:
+            march_bg_mask = row;
+            break;
+        case BG_COL_STRIPE:
+            march_bg_mask = col;
+            break;
+        case BG_DOUBLE_CHECKER:
+            march_bg_mask = (row << 1) | (col << 1);
+            break;
+        default:
+            march_bg_mask = 0;
+            break;
+    }
 }
 
 // Low level routines for march-b algorithm
 static inline bool me_r0(int a)
 {
-    int bit = ram_read(a) & ram_bit_mask;
-    return (bit == 0);
+    int word = ram_read(a);
+    uint32_t bg = march_bg(a);
+    if ((word & ram_bit_mask) == (bg & ram_bit_mask)) return true;
+    return test_fail(a, (~ram_bit_mask ^ bg) & ram_word_mask, word & ram_word_mask);
 }
 
 static inline bool me_r1(int a)
 {
-    int bit = ram_read(a) & ram_bit_mask;
-    return (bit == ram_bit_mask);
+    int word = ram_read(a);
+    uint32_t bg = march_bg(a);
+    if ((word & ram_bit_mask) == (~bg & ram_bit_mask)) return true;
+    return test_fail(a, (ram_bit_mask ^ bg) & ram_word_mask, word & ram_word_mask);
 }
 
 static inline bool me_w0(int a)
 {
-    ram_write(a, ~ram_bit_mask);
+    ram_write(a, ~ram_bit_mask ^ march_bg(a));
     return true;
 }
 
 static inline bool me_w1(int a)
 {
-    ram_write(a, ram_bit_mask);
+    ram_write(a, ram_bit_mask ^ march_bg(a));
     return true;
 }
 
@@ -202,38 +590,94 @@ static inline bool marchb_m4(int a)
     return me_r0(a) && me_w1(a) && me_w0(a);
 }
 
+static inline bool marchb_m5(int a)
+{
+    return me_r0(a) && me_w1(a);
+}
+
+static inline bool marchb_m6(int a)
+{
+    return me_r1(a) && me_w0(a);
+}
+
+// Address orders for the march elements. Each one maps step n to an
+// address in a couple of ALU operations, so the access rate doesn't drop.
+// Descending runs the same order backwards.
+#define ORDER_LINEAR 0
+#define ORDER_STRIDE 1      // Moving inversion, steps of 2^march_stride
+#define ORDER_COMPLEMENT 2  // Ping-pong between a and ~a
+#define ORDER_GRAY 3        // One address bit changes per step
+
+static uint8_t march_order = ORDER_LINEAR;
+static uint8_t march_stride;
+static uint8_t march_width;  // Address bits
+
+static inline int march_addr(uint32_t n, uint32_t mask)
+{
+    switch (march_order) {
+        case ORDER_STRIDE:
+            return ((n << march_stride) | (n >> (march_width - march_stride))) & mask;
+        case ORDER_COMPLEMENT:
+            return (n >> 1) ^ (-(n & 1) & mask);
+        case ORDER_GRAY:
+            return n ^ (n >> 1);
+        default:
+            return n;
+    }
+}
+
 static inline bool march_element(int addr_size, bool descending, int algorithm)
 {
-    int inc = descending ? -1 : 1;
-    int start = descending ? (addr_size - 1) : 0;
-    int end = descending ? -1 : addr_size;
+    uint32_t mask = addr_size - 1;
+    uint32_t n;
     int a;
     bool ret;
 
-    stat_cur_subtest = algorithm;
-
-    for (stat_cur_addr = start; stat_cur_addr != end; stat_cur_addr += inc) {
+    status.subtest = algorithm;
+    pio_stats_begin(status.test, algorithm);
+    TRACE(TRACE_MARCH, TR_MARCH_ELEMENT, algorithm, descending);
+
+    for (n = 0; n < addr_size; n++) {
+        a = march_addr(descending ? (mask - n) : n, mask);
+        // Count steps, not addresses, since the stride orders only come
+        // back to a sample point every few thousand accesses
+        if (!test_progress(n)) {
+            pio_stats_end();
+            return false;
+        }
+        TRACE(TRACE_ACCESS, TR_ACCESS, a, algorithm);
         switch (algorithm) {
             case 0:
-                ret = marchb_m0(stat_cur_addr);
+                ret = marchb_m0(a);
                 break;
             case 1:
-                ret = marchb_m1(stat_cur_addr);
+                ret = marchb_m1(a);
                 break;
             case 2:
-                ret = marchb_m2(stat_cur_addr);
+                ret = marchb_m2(a);
                 break;
             case 3:
-                ret = marchb_m3(stat_cur_addr);
+                ret = marchb_m3(a);
                 break;
             case 4:
-                ret = marchb_m4(stat_cur_addr);
+                ret = marchb_m4(a);
+                break;
+            case 5:
+                ret = marchb_m5(a);
+                break;
+            case 6:
+                ret = marchb_m6(a);
                 break;
             default:
                 break;
         }
-        if (!ret) return false;
+        if (!ret) {
+            TRACE(TRACE_MARCH, TR_MARCH_FAIL, a, ram_bit_mask);
+            pio_stats_end();
+            return false;
+        }
     }
+    pio_stats_end();
     return true;
 }
 
@@ -253,140 +697,1710 @@ uint32_t marchb_testbit(uint32_t addr_size)
     return true;
 }
 
+// Address decoder march, up(w0); up(r0,w1); down(r1,w0), run in every
+// stride, complement and Gray order. Decoder delay faults only show up
+// when particular address bits change from one access to the next.
+static bool march_orders(uint32_t addr_size)
+{
+    uint8_t order, stride;
+    bool ret = true;
+
+    march_width = __builtin_ctz(addr_size);
+    for (order = ORDER_STRIDE; ret && (order <= ORDER_GRAY); order++) {
+        march_order = order;
+        for (stride = (order == ORDER_STRIDE) ? 1 : 0; ret && (stride < march_width); stride++) {
+            march_stride = stride;
+            ret = march_element(addr_size, false, 0) &&
+                  march_element(addr_size, false, 5) &&
+                  march_element(addr_size, true, 6);
+            if (order != ORDER_STRIDE) break;
+        }
+    }
+    march_order = ORDER_LINEAR;
+    return ret;
+}
+
 // Runs the memory test on the 2nd core
 uint32_t marchb_test(uint32_t addr_size, uint32_t bits)
 {
     int failed = 0;
     int bit = 0;
+    int bg;
 
+    ram_word_mask = (1 << bits) - 1;
     for (bit = 0; bit < bits; bit++) {
-        stat_cur_bit = bit;
+        status.bit = bit;
         ram_bit_mask = 1 << bit;
         if (!marchb_testbit(addr_size)) {
             failed |= 1 << bit; // fail flag
         }
+        if (job_cancelled()) break;
+    }
+    // Topology backgrounds, all bits of a word at once
+    for (bg = BG_CHECKER; !failed && (bg < NUM_BACKGROUNDS); bg++) {
+        if (job_cancelled()) break;
+        status.bit = 0;
+        ram_bit_mask = ram_word_mask;
+        march_set_background(bg);
+        if (!marchb_testbit(addr_size)) {
+            failed = test_result.expected ^ test_result.actual;
+        }
+    }
+    march_set_background(BG_SOLID);
+    // The decoder is shared by all the bits, so one bit is enough here
+    if (!failed && !job_cancelled()) {
+        status.bit = 0;
+        ram_bit_mask = 1;
+        if (!march_orders(addr_size)) failed = 1;
     }
 
     return (uint32_t)failed;
 }
 
-#define PSEUDO_VALUES 64
-#define ARTISANAL_NUMBER 42
-static uint64_t random_seeds[PSEUDO_VALUES];
-
-void psrand_init_seeds()
+#define PSEUDO_VALUES 64
+#define ARTISANAL_NUMBER 42
+static uint64_t random_seeds[PSEUDO_VALUES];
+
+void psrand_init_seeds()
+{
+    int i;
+    psrand_seed(ARTISANAL_NUMBER);
+    for (i = 0; i < PSEUDO_VALUES; i++) {
+        random_seeds[i] = psrand_next();
+    }
+}
+
+static int psrand_bitcount = 0;
+static uint32_t psrand_cur;
+
+// Throws away the bits left over from the last word, so a reseeded stream
+// starts on a fresh one even if the last pass stopped part way through
+static inline void psrand_bits_reset()
+{
+    psrand_bitcount = 0;
+}
+
+uint32_t psrand_next_bits(uint32_t bits)
+{
+    uint32_t out;
+
+    if (psrand_bitcount < bits) {
+        psrand_cur = psrand_next();
+        psrand_bitcount = 32;
+    }
+
+    out = psrand_cur & ((1 << (bits)) - 1);
+    psrand_cur = psrand_cur >> bits;
+    psrand_bitcount -= bits;
+    return out;
+}
+
+
+// Galois LFSR feedback masks with a full period, by address width
+static const uint32_t lfsr_taps[21] = {0, 0, 0x3, 0x6, 0xc, 0x14, 0x30, 0x60, 0xb8, 0x110, 0x240,
+                                       0x500, 0xe08, 0x1c80, 0x3802, 0x6000, 0xd008, 0x12000,
+                                       0x20400, 0x72000, 0x90000};
+
+// Next address of a walk that visits every address once in pseudorandom
+// order. Zero isn't on the LFSR's cycle, so the walk starts there and then
+// runs the cycle from 1. Anything past the end of the chip is skipped.
+static inline int lfsr_step(int a, uint32_t taps, uint32_t addr_size)
+{
+    if (a == 0) return 1;
+    do {
+        a = (a >> 1) ^ (-(a & 1) & taps);
+    } while (a >= addr_size);
+    return a;
+}
+
+// One more pseudorandom pattern, written and read in LFSR address order.
+// This catches faults that depend on the address sequence, which the
+// linear passes always run the same way.
+static uint32_t psrandom_lfsr(uint32_t addr_size, uint32_t bits)
+{
+    uint32_t taps = lfsr_taps[32 - __builtin_clz(addr_size - 1)];
+    uint32_t bitsout, bitsin;
+    uint32_t n;
+    int a;
+
+    status.subtest = PSEUDO_VALUES >> 2;
+    status.bit = 0;
+    cur_seed = random_seeds[0];
+    psrand_seed(cur_seed);
+    pio_stats_begin(status.test, 2);
+    for (n = 0, a = 0; n < addr_size; n++, a = lfsr_step(a, taps, addr_size)) {
+        if (!test_progress(n)) {
+            pio_stats_end();
+            return 1;
+        }
+        ram_write(a, psrand_next_bits(bits));
+    }
+    pio_stats_end();
+
+    psrand_seed(cur_seed);
+    pio_stats_begin(status.test, 3);
+    for (n = 0, a = 0; n < addr_size; n++, a = lfsr_step(a, taps, addr_size)) {
+        if (!test_progress(n)) {
+            pio_stats_end();
+            return 1;
+        }
+        bitsout = psrand_next_bits(bits);
+        bitsin = ram_read(a);
+        if (bitsout != bitsin) {
+            TRACE(TRACE_PSRAND, TR_PSRAND_FAIL, a, (bitsout << 16) | bitsin);
+            pio_stats_end();
+            test_fail(a, bitsout, bitsin);
+            return bitsout ^ bitsin;
+        }
+    }
+    pio_stats_end();
+    return 0;
+}
+
+// Pseudorandom test
+uint32_t psrandom_test(uint32_t addr_size, uint32_t bits)
+{
+    uint i;
+    int a;
+    uint32_t bitsout;
+    uint32_t bitsin;
+    uint32_t bitshift = addr_size / 4;
+
+    // Write seeded pseudorandom data
+    for (i = 0; i < PSEUDO_VALUES; i++) {
+        status.subtest = i >> 2;
+        status.bit = i & 3;
+        cur_seed = random_seeds[i];
+        psrand_seed(cur_seed);
+        TRACE(TRACE_PSRAND, TR_PSRAND_PATTERN, i, (uint32_t)random_seeds[i]);
+        pio_stats_begin(status.test, 0);
+        for (a = 0; a < addr_size; a++) {
+            if (!test_progress(a)) {
+                pio_stats_end();
+                return 1;
+            }
+            bitsout = psrand_next_bits(bits);
+            ram_write(a, bitsout);
+        }
+        pio_stats_end();
+
+        // Reseed and then read the data back
+        psrand_seed(random_seeds[i]);
+        pio_stats_begin(status.test, 1);
+        for (a = 0; a < addr_size; a++) {
+            if (!test_progress(a)) {
+                pio_stats_end();
+                return 1;
+            }
+            bitsout = psrand_next_bits(bits);
+            bitsin = ram_read(a);
+            if (bitsout != bitsin) {
+                TRACE(TRACE_PSRAND, TR_PSRAND_FAIL, a, (bitsout << 16) | bitsin);
+                pio_stats_end();
+                test_fail(a, bitsout, bitsin);
+                return bitsout ^ bitsin;
+            }
+        }
+        pio_stats_end();
+    }
+
+    return psrandom_lfsr(addr_size, bits);
+}
+
+uint32_t refresh_subtest(uint32_t addr_size, uint32_t bits, uint32_t time_delay)
+{
+    int a;
+    uint32_t bitsout;
+    uint32_t bitsin;
+
+    cur_seed = random_seeds[0];
+    psrand_seed(cur_seed);
+    TRACE(TRACE_REFRESH, TR_REFRESH_WRITE, addr_size, bits);
+    pio_stats_begin(status.test, 0);
+    for (a = 0; a < addr_size; a++) {
+        if (!test_progress(a)) {
+            pio_stats_end();
+            return 1;
+        }
+        bitsout = psrand_next_bits(bits);
+        ram_write(a, bitsout);
+    }
+    pio_stats_end();
+
+    TRACE(TRACE_REFRESH, TR_REFRESH_WAIT, time_delay, 0);
+    sleep_us(time_delay);
+
+    psrand_seed(random_seeds[0]);
+    pio_stats_begin(status.test, 1);
+    for (a = 0; a < addr_size; a++) {
+        if (!test_progress(a)) {
+            pio_stats_end();
+            return 1;
+        }
+        bitsout = psrand_next_bits(bits);
+        bitsin = ram_read(a);
+        if (bitsout != bitsin) {
+            TRACE(TRACE_REFRESH, TR_REFRESH_FAIL, a, (bitsout << 16) | bitsin);
+            pio_stats_end();
+            test_fail(a, bitsout, bitsin);
+            return bitsout ^ bitsin;
+        }
+    }
+    pio_stats_end();
+    return 0;
+}
+
+
+uint32_t refresh_test(uint32_t addr_size, uint32_t bits)
+{
+    return refresh_subtest(addr_size, bits, 5000);
+}
+
+
+static const char *ram_test_names[] = {"March-B", "Pseudo", "Refresh", "Retention", "CBR",
+                                       "Nibble", "Page", "Hammer", "Long RAS", "NPSF",
+                                       "Switching", "Access"};
+
+// CAS-before-RAS refresh test. The array is kept alive with CBR cycles
+// only, so every row has to come from the chip's own refresh counter.
+// That only proves something if the cells can't hold their data for that
+// long on their own, so first find a hold time that loses data without
+// refresh (the control run).
+#define CBR_FIRST_HOLD_MS 64
+#define CBR_MAX_HOLD_MS 2048
+
+typedef struct {
+    uint32_t hold_ms;  // Hold time of the CBR run
+    uint32_t lost;     // Failing bits from the control run at that hold time
+} cbr_report_t;
+
+static cbr_report_t cbr_report;
+
+static bool cbr_fill(uint32_t addr_size, uint32_t bits)
+{
+    int a;
+    pio_stats_begin(status.test, 0);
+    psrand_seed(cur_seed);
+    psrand_bits_reset();
+    for (a = 0; a < addr_size; a++) {
+        if (!test_progress(a)) {
+            pio_stats_end();
+            return false;
+        }
+        ram_write(a, psrand_next_bits(bits));
+    }
+    pio_stats_end();
+    return true;
+}
+
+// Returns the failing bits. Only the CBR run records failures.
+static uint32_t cbr_check(uint32_t addr_size, uint32_t bits, bool record)
+{
+    uint32_t lost = 0;
+    uint32_t bitsout, bitsin;
+    int a;
+    pio_stats_begin(status.test, 1);
+    psrand_seed(cur_seed);
+    // The control run stops at its first loss, part way through a word
+    psrand_bits_reset();
+    for (a = 0; a < addr_size; a++) {
+        if (!test_progress(a)) break;
+        bitsout = psrand_next_bits(bits);
+        bitsin = ram_read(a);
+        if (bitsout != bitsin) {
+            lost |= bitsout ^ bitsin;
+            if (!record) break;
+            test_fail(a, bitsout, bitsin);
+        }
+    }
+    pio_stats_end();
+    return lost;
+}
+
+// Leaves the array alone for hold_ms, apart from CBR bursts if asked for.
+// Each burst steps the counter once per row, twice per refresh period.
+static bool cbr_hold(uint32_t hold_ms, bool refresh)
+{
+    const mem_chip_t *chip = chip_list[main_menu.sel_line];
+    uint rows = 1 << chip->row_bits;
+    uint32_t period = chip->refresh_ms * 1000;
+    uint32_t start = time_us_32();
+    uint32_t last = start - period;
+    uint32_t now = start;
+    uint r;
+
+    while ((now - start) < hold_ms * 1000) {
+        if (job_cancelled()) return false;
+        if (refresh && ((now - last) >= period / 2)) {
+            last = now;
+            ram_cycle_begin();
+            for (r = 0; r < rows; r++) {
+                ram_cycle_cbr();
+            }
+            ram_cycle_end();
+        }
+        now = time_us_32();
+    }
+    return true;
+}
+
+uint32_t cbr_test(uint32_t addr_size, uint32_t bits)
+{
+    uint32_t hold = CBR_FIRST_HOLD_MS;
+    uint32_t lost;
+
+    cur_seed = random_seeds[1];
+    status.subtest = 0;
+    TRACE(TRACE_REFRESH, TR_REFRESH_WRITE, addr_size, bits);
+    while (1) {
+        if (!cbr_fill(addr_size, bits)) return 1;
+        TRACE(TRACE_REFRESH, TR_REFRESH_WAIT, hold * 1000, 0);
+        if (!cbr_hold(hold, false)) return 1;
+        lost = cbr_check(addr_size, bits, false);
+        if (lost || (hold >= CBR_MAX_HOLD_MS)) break;
+        hold *= 2;
+    }
+    cbr_report.hold_ms = hold;
+    cbr_report.lost = lost;
+
+    status.subtest = 1;
+    if (!cbr_fill(addr_size, bits)) return 1;
+    TRACE(TRACE_REFRESH, TR_REFRESH_WAIT, hold * 1000, 1);
+    if (!cbr_hold(hold, true)) return 1;
+    return cbr_check(addr_size, bits, true);
+}
+
+// Nibble mode test, for the variants that run in nibble mode. The four
+// bits of a nibble share a RAS# cycle and are picked by the top row and
+// column address bits, which the chip steps as a two bit counter with the
+// row bit lowest. The test treats each nibble as a 4 bit word, then starts
+// nibbles part way through the sequence to check that the counter wraps.
+#define NIBBLE_ELEMENTS 5
+
+static inline int ram_read_nibble(int addr)
+{
+    refresh_mark(addr);
+    return chip_list[main_menu.sel_line]->ram_read_nibble(addr);
+}
+
+static inline void ram_write_nibble(int addr, int data)
+{
+    refresh_mark(addr);
+    chip_list[main_menu.sel_line]->ram_write_nibble(addr, data);
+}
+
+// Address of the bit at counter value c in nibble g
+static inline int nibble_addr(uint32_t addr_size, int g, int c)
+{
+    uint row_bits = chip_list[main_menu.sel_line]->row_bits;
+    uint low = g & ((1 << (row_bits - 1)) - 1);
+    uint high = g >> (row_bits - 1);
+    return low | (high << row_bits) | ((c & 1) << (row_bits - 1)) | ((c >> 1) * (addr_size >> 1));
+}
+
+// A nibble read from counter value c sees the stored bits rotated by c
+static inline uint32_t nibble_rotate(uint32_t d, int c)
+{
+    return ((d >> c) | (d << (4 - c))) & 0xf;
+}
+
+static bool nibble_check(uint32_t addr_size, int g, int c, uint32_t expected)
+{
+    int a = nibble_addr(addr_size, g, c);
+    uint32_t got = ram_read_nibble(a);
+    if (got == expected) return true;
+    return test_fail(a, expected, got);
+}
+
+// Word oriented march: up(w d); up(r d, w ~d); down(r ~d, w d); up(r d)
+static bool nibble_march(uint32_t addr_size, uint32_t d)
+{
+    int groups = addr_size / 4;
+    uint32_t nd = ~d & 0xf;
+    int g;
+
+    for (g = 0; g < groups; g++) {
+        if (!test_progress(nibble_addr(addr_size, g, 0))) return false;
+        ram_write_nibble(nibble_addr(addr_size, g, 0), d);
+    }
+    for (g = 0; g < groups; g++) {
+        if (!test_progress(nibble_addr(addr_size, g, 0))) return false;
+        if (!nibble_check(addr_size, g, 0, d)) return false;
+        ram_write_nibble(nibble_addr(addr_size, g, 0), nd);
+    }
+    for (g = groups - 1; g >= 0; g--) {
+        if (!test_progress(nibble_addr(addr_size, g, 0))) return false;
+        if (!nibble_check(addr_size, g, 0, nd)) return false;
+        ram_write_nibble(nibble_addr(addr_size, g, 0), d);
+    }
+    for (g = 0; g < groups; g++) {
+        if (!test_progress(nibble_addr(addr_size, g, 0))) return false;
+        if (!nibble_check(addr_size, g, 0, d)) return false;
+    }
+    return true;
+}
+
+// Pseudorandom nibbles. Element 2 writes and reads from the start of each
+// nibble, element 3 reads back from the other three starting points and
+// element 4 writes from a rotating starting point and reads from the start.
+static bool nibble_wrap(uint32_t addr_size, int element)
+{
+    int groups = addr_size / 4;
+    int g, c;
+    uint32_t d;
+
+    cur_seed = random_seeds[element];
+    psrand_seed(cur_seed);
+    for (g = 0; g < groups; g++) {
+        if (!test_progress(nibble_addr(addr_size, g, 0))) return false;
+        d = psrand_next_bits(4);
+        c = (element == 4) ? (g & 3) : 0;
+        ram_write_nibble(nibble_addr(addr_size, g, c), nibble_rotate(d, c));
+    }
+    for (c = (element == 3) ? 1 : 0; c < ((element == 3) ? 4 : 1); c++) {
+        psrand_seed(cur_seed);
+        for (g = 0; g < groups; g++) {
+            if (!test_progress(nibble_addr(addr_size, g, 0))) return false;
+            d = psrand_next_bits(4);
+            if (!nibble_check(addr_size, g, c, nibble_rotate(d, c))) return false;
+        }
+    }
+    return true;
+}
+
+uint32_t nibble_test(uint32_t addr_size, uint32_t bits)
+{
+    int el;
+    bool ok;
+
+    for (el = 0; el < NIBBLE_ELEMENTS; el++) {
+        status.subtest = el;
+        pio_stats_begin(status.test, el);
+        switch (el) {
+            case 0:
+                ok = nibble_march(addr_size, 0x0);
+                break;
+            case 1:
+                ok = nibble_march(addr_size, 0x5);
+                break;
+            default:
+                ok = nibble_wrap(addr_size, el);
+                break;
+        }
+        pio_stats_end();
+        if (!ok) return 1;
+    }
+    return 0;
+}
+
+// Fast page mode test. Whole rows are written and read back with RAS# held
+// low and only CAS# cycling, in bursts short enough to stay inside tRAS max.
+// Then the CAS# high time of the page loop (delay field 7) is cut a cycle at
+// a time on a few rows, to see how much tCP and tPC margin the chip has at
+// this speed grade. Field 6 is left alone since the RAS# close path uses it
+// too, and a failure there would not be a page timing margin.
+#define PAGE_BURST 16        // Columns per RAS# cycle
+#define PAGE_MARGIN_ROWS 16  // Rows used while margining
+#define PAGE_TRIM_MAX 31
+
+typedef struct {
+    uint8_t trim;   // Cycles taken off the page loop that still passed
+    bool limited;   // Ran out of delay to cut before anything failed
+} page_report_t;
+
+static page_report_t page_report;
+
+// Writes and reads back one row, a burst at a time. Returns the failing bits.
+static uint32_t page_row(uint32_t addr_size, uint32_t bits, uint row, bool record)
+{
+    uint row_bits = chip_list[main_menu.sel_line]->row_bits;
+    uint cols = addr_size >> row_bits;
+    uint32_t lost = 0;
+    uint32_t bitsout, bitsin;
+    uint c;
+    int a;
+
+    psrand_seed(cur_seed + row);
+    for (c = 0; c < cols; c++) {
+        ram_page_hold = ((c % PAGE_BURST) != PAGE_BURST - 1);
+        ram_write(row | (c << row_bits), psrand_next_bits(bits));
+    }
+    psrand_seed(cur_seed + row);
+    for (c = 0; c < cols; c++) {
+        ram_page_hold = ((c % PAGE_BURST) != PAGE_BURST - 1);
+        a = row | (c << row_bits);
+        bitsout = psrand_next_bits(bits);
+        bitsin = ram_read(a);
+        if (bitsout != bitsin) {
+            lost |= bitsout ^ bitsin;
+            if (record) test_fail(a, bitsout, bitsin);
+        }
+    }
+    ram_page_hold = 0;
+    return lost;
+}
+
+// Cuts trim cycles out of the page loop. Returns false if there isn't that
+// much delay to cut.
+static bool page_trim(uint trim)
+{
+    ram_cycle_wait_idle(pio, sm);
+    return pio_trim_delays(pio, offset, 7, trim) == trim;
+}
+
+uint32_t page_test(uint32_t addr_size, uint32_t bits)
+{
+    uint rows = 1 << chip_list[main_menu.sel_line]->row_bits;
+    uint32_t lost = 0;
+    uint trim, r;
+
+    cur_seed = random_seeds[2];
+    memset(&page_report, 0, sizeof(page_report));
+    status.subtest = 0;
+    pio_stats_begin(status.test, 0);
+    for (r = 0; r < rows; r++) {
+        if (!test_progress_row(addr_size, r)) break;
+        lost = page_row(addr_size, bits, r, true);
+        if (lost) break;
+    }
+    pio_stats_end();
+    if (lost || job_cancelled()) return lost ? lost : 1;
+
+    status.subtest = 1;
+    pio_stats_begin(status.test, 1);
+    for (trim = 1; trim <= PAGE_TRIM_MAX; trim++) {
+        if (!page_trim(trim)) {
+            page_report.limited = true;
+            break;
+        }
+        for (r = 0; r < rows; r += rows / PAGE_MARGIN_ROWS) {
+            if (!test_progress_row(addr_size, r)) break;
+            lost = page_row(addr_size, bits, r, false);
+            if (lost) break;
+        }
+        if (lost || job_cancelled()) break;
+        page_report.trim = trim;
+    }
+    page_trim(0);
+    pio_stats_end();
+    return job_cancelled() ? 1 : 0;
+}
+
+// Type-1 neighbourhood pattern sensitive faults: a cell and its four
+// neighbours up, down, left and right. Tiling gives every cell the tile
+// number (row + 2 * col) mod 5, so each neighbourhood holds exactly one cell
+// of each number and the whole array goes through the 32 neighbourhood
+// patterns together. The patterns are stepped in Gray code order. Each step
+// rewrites the cells of one tile number and then reads back the whole array.
+// Rows go through in page mode where the chip has it.
+#define NPSF_PATTERNS 32
+
+static bool npsf_page;
+static uint npsf_row_shift;  // Row index bits below the physical row (bank)
+
+// Rewrites every cell with the given tile number
+static bool npsf_write(uint32_t addr_size, uint tile, uint32_t data)
+{
+    uint row_bits = chip_list[main_menu.sel_line]->row_bits;
+    uint rows = 1 << row_bits;
+    uint cols = addr_size >> row_bits;
+    uint r, c, n;
+
+    for (r = 0; r < rows; r++) {
+        if (!test_progress_row(addr_size, r)) return false;
+        // 3 is the inverse of 2 mod 5, so this is the first matching column
+        c = ((tile + 5 - (r >> npsf_row_shift) % 5) * 3) % 5;
+        for (n = 1; c < cols; c += 5, n++) {
+            ram_page_hold = npsf_page && (c + 5 < cols) && ((n % PAGE_BURST) != 0);
+            ram_write(r | (c << row_bits), data);
+        }
+    }
+    return true;
+}
+
+// Checks the whole array against a pattern. Rows are always finished,
+// so RAS# is never left low. Returns the failing bits.
+static uint32_t npsf_read(uint32_t addr_size, uint32_t pattern)
+{
+    uint row_bits = chip_list[main_menu.sel_line]->row_bits;
+    uint rows = 1 << row_bits;
+    uint cols = addr_size >> row_bits;
+    uint32_t lost = 0;
+    uint32_t bitsout, bitsin;
+    uint r, c, t;
+    int a;
+
+    for (r = 0; r < rows; r++) {
+        if (!test_progress_row(addr_size, r)) break;
+        t = (r >> npsf_row_shift) % 5;
+        for (c = 0; c < cols; c++) {
+            ram_page_hold = npsf_page && (c + 1 < cols) && (((c + 1) % PAGE_BURST) != 0);
+            a = r | (c << row_bits);
+            bitsout = -((pattern >> t) & 1) & ram_word_mask;
+            bitsin = ram_read(a);
+            if (bitsout != bitsin) {
+                lost |= bitsout ^ bitsin;
+                test_fail(a, bitsout, bitsin);
+            }
+            t += 2;
+            if (t >= 5) t -= 5;
+        }
+        if (lost) break;
+    }
+    return lost;
+}
+
+uint32_t npsf_test(uint32_t addr_size, uint32_t bits)
+{
+    const mem_chip_t *chip = chip_list[main_menu.sel_line];
+    uint32_t pattern = 0;
+    uint32_t lost;
+    uint step, tile;
+
+    npsf_page = (chip->caps & MEM_CAP_PAGE) &&
+                !(chip->nibble_variants & (1 << variants_menu.sel_line));
+    npsf_row_shift = chip->cycle_map->banks - 1;
+    ram_word_mask = (1 << bits) - 1;
+
+    status.subtest = 0;
+    pio_stats_begin(status.test, 0);
+    for (tile = 0; tile < 5; tile++) {
+        if (!npsf_write(addr_size, tile, 0)) break;
+    }
+    pio_stats_end();
+    if (job_cancelled()) return 1;
+
+    for (step = 1; step <= NPSF_PATTERNS; step++) {
+        // The Gray code bit that changes at this step. The last step wraps
+        // back to all zeros through the top bit.
+        tile = __builtin_ctz(step);
+        if (tile > 4) tile = 4;
+        pattern ^= 1 << tile;
+        status.subtest = step;
+        pio_stats_begin(status.test, 0);
+        npsf_write(addr_size, tile, -((pattern >> tile) & 1) & ram_word_mask);
+        pio_stats_end();
+        pio_stats_begin(status.test, 1);
+        lost = npsf_read(addr_size, pattern);
+        pio_stats_end();
+        if (job_cancelled()) return 1;
+        if (lost) return lost;
+    }
+    return 0;
+}
+
+// Long RAS# low stress. The array is filled, then every row is read in
+// fast page mode with RAS# held low for as close to tRAS max as we can get,
+// reopening the row until all its columns have been read. Then the whole
+// array is checked, since holding a row open for that long is hard on the
+// cells sharing its bit lines as well as on the row itself.
+#ifndef LONG_RAS_US
+#define LONG_RAS_US 10          // tRAS max, 10us on most of these parts
+#endif
+
+static inline uint32_t long_ras_data(int a, bool invert)
+{
+    uint32_t d = ((uint32_t)a * 0x9e3779b1u) >> 16;
+    return (invert ? ~d : d) & ram_word_mask;
+}
+
+// Checks one address, recording the first failure. Returns the failing bits.
+static inline uint32_t long_ras_check(int a, bool invert)
+{
+    uint32_t bitsout = long_ras_data(a, invert);
+    uint32_t bitsin = ram_read(a);
+    if (bitsout == bitsin) return 0;
+    test_fail(a, bitsout, bitsin);
+    return bitsout ^ bitsin;
+}
+
+// Reads a row with RAS# held low for up to LONG_RAS_US at a time
+static uint32_t long_ras_row(uint32_t addr_size, uint row, bool invert)
+{
+    uint row_bits = chip_list[main_menu.sel_line]->row_bits;
+    uint cols = addr_size >> row_bits;
+    uint32_t lost = 0;
+    uint32_t start;
+    uint c = 0;
+
+    while (c < cols) {
+        start = time_us_32();
+        do {
+            // Decide before each access whether RAS# may stay low after it
+            ram_page_hold = (c + 1 < cols) && ((time_us_32() - start) < LONG_RAS_US - 1);
+            lost |= long_ras_check(row | (c << row_bits), invert);
+            c++;
+        } while (ram_page_hold);
+    }
+    return lost;
+}
+
+uint32_t long_ras_test(uint32_t addr_size, uint32_t bits)
+{
+    uint rows = 1 << chip_list[main_menu.sel_line]->row_bits;
+    uint32_t lost = 0;
+    uint pass, r;
+    bool invert;
+    int a;
+
+    ram_word_mask = (1 << bits) - 1;
+    for (pass = 0; pass < 2; pass++) {
+        invert = (pass == 1);
+        status.subtest = pass;
+        pio_stats_begin(status.test, pass);
+        for (a = 0; a < addr_size; a++) {
+            if (!test_progress(a)) break;
+            ram_write(a, long_ras_data(a, invert));
+        }
+        for (r = 0; r < rows; r++) {
+            if (!test_progress_row(addr_size, r)) break;
+            lost |= long_ras_row(addr_size, r, invert);
+        }
+        for (a = 0; a < addr_size; a++) {
+            if (!test_progress(a)) break;
+            lost |= long_ras_check(a, invert);
+        }
+        pio_stats_end();
+        if (lost || job_cancelled()) break;
+    }
+    if (job_cancelled()) return 1;
+    return lost;
+}
+
+// Row hammer. Each row in turn is the aggressor: its neighbours are filled
+// with data, then the cycle player opens the aggressor over and over as
+// fast as tRP and tRAS allow, and the neighbours are read back for flips.
+// Neighbours are the next row index up and down in the same bank, which
+// is only the physical neighbour if the chip doesn't scramble its rows.
+// The hammer has to finish inside half a refresh period, or we'd be
+// testing retention instead, so HAMMER_COUNT is capped to fit.
+#ifndef HAMMER_COUNT
+#define HAMMER_COUNT 0          // 0 = as many as fit
+#endif
+
+#define HAMMER_MAX_ROWS 512
+#define HAMMER_PATTERNS 2
+
+typedef struct {
+    uint32_t count;             // Activations per aggressor
+    uint32_t flips;             // Flipped bits, all row pairs
+    uint16_t rows;
+    uint8_t step;               // Row index distance to a neighbour
+    uint16_t below[HAMMER_MAX_ROWS]; // Flips in row - step, by aggressor
+    uint16_t above[HAMMER_MAX_ROWS]; // Flips in row + step, by aggressor
+} hammer_report_t;
+
+static hammer_report_t hammer_report;
+
+static void hammer_fill(uint32_t addr_size, uint32_t bits, uint row, uint32_t data)
+{
+    uint row_bits = chip_list[main_menu.sel_line]->row_bits;
+    uint c;
+
+    for (c = 0; c < (addr_size >> row_bits); c++) {
+        ram_write(row | (c << row_bits), data);
+    }
+}
+
+// Counts flipped bits in a victim row, recording the first one
+static uint hammer_check(uint32_t addr_size, uint32_t bits, uint row, uint32_t data,
+                         uint32_t *failed)
+{
+    uint row_bits = chip_list[main_menu.sel_line]->row_bits;
+    uint32_t in;
+    uint flips = 0;
+    uint c;
+    int a;
+
+    for (c = 0; c < (addr_size >> row_bits); c++) {
+        a = row | (c << row_bits);
+        in = ram_read(a);
+        if (in != data) {
+            flips += __builtin_popcount(in ^ data);
+            *failed |= in ^ data;
+            test_fail(a, data, in);
+        }
+    }
+    return flips;
+}
+
+uint32_t hammer_test(uint32_t addr_size, uint32_t bits)
+{
+    const mem_chip_t *chip = chip_list[main_menu.sel_line];
+    uint32_t max_count = chip->refresh_ms * 1000000 / 2 / ram_cycle_ras_ns();
+    uint32_t failed = 0;
+    uint32_t victim;
+    uint pat, r, f;
+
+    memset(&hammer_report, 0, sizeof(hammer_report));
+    hammer_report.rows = 1 << chip->row_bits;
+    hammer_report.step = chip->cycle_map->banks;
+    hammer_report.count = HAMMER_COUNT;
+    if ((hammer_report.count == 0) || (hammer_report.count > max_count)) {
+        hammer_report.count = max_count;
+    }
+
+    for (pat = 0; pat < HAMMER_PATTERNS; pat++) {
+        status.subtest = pat;
+        // Victims hold the opposite of the aggressor
+        victim = pat ? 0 : ram_word_mask;
+        pio_stats_begin(status.test, pat);
+        for (r = 0; r < hammer_report.rows; r++) {
+            if (!test_progress_row(addr_size, r)) break;
+            hammer_fill(addr_size, bits, r, ~victim & ram_word_mask);
+            if (r >= hammer_report.step) {
+                hammer_fill(addr_size, bits, r - hammer_report.step, victim);
+            }
+            if (r + hammer_report.step < hammer_report.rows) {
+                hammer_fill(addr_size, bits, r + hammer_report.step, victim);
+            }
+            ram_cycle_begin();
+            ram_cycle_hammer(r, hammer_report.count);
+            ram_cycle_end();
+            if (r >= hammer_report.step) {
+                f = hammer_check(addr_size, bits, r - hammer_report.step, victim, &failed);
+                hammer_report.below[r] += f;
+                hammer_report.flips += f;
+            }
+            if (r + hammer_report.step < hammer_report.rows) {
+                f = hammer_check(addr_size, bits, r + hammer_report.step, victim, &failed);
+                hammer_report.above[r] += f;
+                hammer_report.flips += f;
+            }
+        }
+        pio_stats_end();
+        if (job_cancelled()) return 1;
+    }
+    return failed;
+}
+
+// Sends the row pairs that flipped out over USB
+static void hammer_report_print(const hammer_report_t *rep)
+{
+    uint r;
+
+    printf("Hammer: %lu activations per row, %lu flips\n", (unsigned long)rep->count,
+           (unsigned long)rep->flips);
+    for (r = 0; r < rep->rows; r++) {
+        if (rep->below[r]) {
+            printf("  aggressor %03x victim %03x: %u\n", r, r - rep->step, rep->below[r]);
+        }
+        if (rep->above[r]) {
+            printf("  aggressor %03x victim %03x: %u\n", r, r + rep->step, rep->above[r]);
+        }
+    }
+}
+
+// Worst case switching. Consecutive accesses go to a and ~a, so every row
+// and column address line flips each cycle, and the data flips between all
+// zeros and all ones along with them. The pairs step through a Gray code,
+// so going from one pair to the next flips all lines but one as well.
+// The chip routines are kept SWITCH_DEPTH accesses ahead of the results,
+// so the program runs the cycles back to back at the grade's tRC instead
+// of waiting on us in between. Marginal parts that only make a slower
+// grade tend to fall over here.
+#define SWITCH_DEPTH 3  // Accesses in flight. The RX FIFO holds 4.
+
+static inline int switch_addr(uint32_t i, uint32_t mask)
+{
+    uint32_t n = i >> 1;
+    n ^= n >> 1;
+    return (i & 1) ? (~n & mask) : n;
+}
+
+static inline uint32_t switch_data(uint32_t i, uint pass)
+{
+    return ((i ^ pass) & 1) ? ram_word_mask : 0;
+}
+
+// Puts SWITCH_DEPTH junk words in the RX FIFO. From then on each call to
+// the chip routines picks up the result of the access SWITCH_DEPTH before
+// it, so it never has to wait for its own.
+static void switch_prime()
+{
+    uint i;
+    ram_cycle_wait_idle(pio, sm);
+    for (i = 0; i < SWITCH_DEPTH; i++) {
+        pio_sm_exec(pio, sm, pio_encode_push(false, false));
+    }
+}
+
+// Lets the accesses in flight finish and throws their results away
+static void switch_drain()
+{
+    uint i;
+    ram_cycle_wait_idle(pio, sm);
+    for (i = 0; i < SWITCH_DEPTH; i++) {
+        pio_sm_get(pio, sm);
+    }
+}
+
+static uint32_t switch_pass(uint32_t addr_size, uint pass)
+{
+    uint32_t mask = addr_size - 1;
+    uint32_t bitsout, bitsin;
+    uint32_t i, j;
+
+    status.subtest = pass;
+    pio_stats_begin(status.test, pass * 2);
+    switch_prime();
+    for (i = 0; i < addr_size; i++) {
+        if (!test_progress(i)) break;
+        ram_write(switch_addr(i, mask), switch_data(i, pass));
+    }
+    switch_drain();
+    pio_stats_end();
+    if (job_cancelled()) return 1;
+
+    pio_stats_begin(status.test, pass * 2 + 1);
+    switch_prime();
+    // The last few reads wrap around to the start, to push out the rest
+    for (i = 0; i < addr_size + SWITCH_DEPTH; i++) {
+        if (!test_progress(i & mask)) break;
+        bitsin = ram_read(switch_addr(i & mask, mask));
+        if (i < SWITCH_DEPTH) continue;
+        j = i - SWITCH_DEPTH;
+        bitsout = switch_data(j, pass);
+        if (bitsout != bitsin) {
+            switch_drain();
+            pio_stats_end();
+            test_fail(switch_addr(j, mask), bitsout, bitsin);
+            return bitsout ^ bitsin;
+        }
+    }
+    switch_drain();
+    pio_stats_end();
+    if (job_cancelled()) return 1;
+    return 0;
+}
+
+uint32_t switch_test(uint32_t addr_size, uint32_t bits)
+{
+    uint32_t failed;
+    uint pass;
+
+    ram_word_mask = (1 << bits) - 1;
+    for (pass = 0; pass < 2; pass++) {
+        failed = switch_pass(addr_size, pass);
+        if (failed) return failed;
+    }
+    return 0;
+}
+
+// Bank switch timing. The 41128 and the stacked 4132 have two RAS# lines,
+// so the PIO can precharge one bank while it works on the other. Time a
+// run of reads that stays in one bank against one that alternates, and
+// count read back errors for both, to see what the interleave buys us and
+// whether switching banks upsets the chip.
+#define BANK_PROBE_READS 4096
+
+typedef struct {
+    uint32_t same_ns;     // Per read, one bank
+    uint32_t alt_ns;      // Per read, alternating banks
+    uint32_t same_errors;
+    uint32_t alt_errors;
+} bank_report_t;
+
+static bank_report_t bank_report;
+
+static inline uint32_t bank_probe_data(int a)
+{
+    return ((a ^ (a >> 1)) & 1) ? ram_word_mask : 0;
+}
+
+// Reads n addresses stepping by stride and returns the time per read
+static uint32_t bank_probe_run(uint32_t addr_size, int stride, uint32_t *errors)
+{
+    uint32_t n = BANK_PROBE_READS;
+    uint32_t start;
+    int a;
+
+    if (n * stride > addr_size) n = addr_size / stride;
+    for (a = 0; a < n * stride; a += stride) {
+        ram_write(a, bank_probe_data(a));
+    }
+    *errors = 0;
+    start = time_us_32();
+    for (a = 0; a < n * stride; a += stride) {
+        if (ram_read(a) != bank_probe_data(a)) (*errors)++;
+    }
+    return (time_us_32() - start) * 1000 / n;
+}
+
+static void bank_probe(uint32_t addr_size)
+{
+    bank_report.same_ns = bank_probe_run(addr_size, 2, &bank_report.same_errors);
+    bank_report.alt_ns = bank_probe_run(addr_size, 1, &bank_report.alt_errors);
+}
+
+// Quick profile, for incoming screening. A short march over all bits at
+// once, a few pseudorandom patterns and the switching stress. The patterns
+// are checked by CRC, so the read back doesn't have to rerun the generator
+// or compare each word. Only when the CRC is off does a second, slow read
+// go looking for the bad cell.
+#define QUICK_PATTERNS 4
+
+// CRC-32 (reflected 0xEDB88320), a nibble at a time
+static const uint32_t crc32_nibble[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+    0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+    0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+static inline uint32_t crc32_word(uint32_t crc, uint32_t w)
+{
+    int i;
+    for (i = 0; i < 8; i++) {
+        crc = (crc >> 4) ^ crc32_nibble[(crc ^ w) & 0xf];
+        w >>= 4;
+    }
+    return crc;
+}
+
+// Words are packed 32 bits at a time before they go into the CRC
+typedef struct {
+    uint32_t crc;
+    uint32_t acc;
+    uint fill;
+} quick_crc_t;
+
+static inline void quick_crc_add(quick_crc_t *c, uint32_t d, uint32_t bits)
+{
+    c->acc = (c->acc << bits) | d;
+    c->fill += bits;
+    if (c->fill == 32) {
+        c->crc = crc32_word(c->crc, c->acc);
+        c->acc = 0;
+        c->fill = 0;
+    }
+}
+
+static inline uint32_t quick_crc_done(quick_crc_t *c)
+{
+    if (c->fill) c->crc = crc32_word(c->crc, c->acc);
+    return ~c->crc;
+}
+
+static uint32_t quick_pattern(uint32_t addr_size, uint32_t bits, uint i)
+{
+    quick_crc_t want = {~0u, 0, 0};
+    quick_crc_t got = {~0u, 0, 0};
+    uint32_t bitsout;
+    uint32_t bitsin;
+    int a;
+
+    status.subtest = i;
+    cur_seed = random_seeds[i];
+    psrand_seed(cur_seed);
+    pio_stats_begin(status.test, 0);
+    for (a = 0; a < addr_size; a++) {
+        if (!test_progress(a)) {
+            pio_stats_end();
+            return 1;
+        }
+        bitsout = psrand_next_bits(bits);
+        ram_write(a, bitsout);
+        quick_crc_add(&want, bitsout, bits);
+    }
+    pio_stats_end();
+
+    pio_stats_begin(status.test, 1);
+    for (a = 0; a < addr_size; a++) {
+        if (!test_progress(a)) {
+            pio_stats_end();
+            return 1;
+        }
+        quick_crc_add(&got, ram_read(a), bits);
+    }
+    pio_stats_end();
+    if (quick_crc_done(&got) == quick_crc_done(&want)) return 0;
+
+    // Something is off. Read it again the slow way to find out where.
+    psrand_seed(cur_seed);
+    for (a = 0; a < addr_size; a++) {
+        if (!test_progress(a)) return 1;
+        bitsout = psrand_next_bits(bits);
+        bitsin = ram_read(a);
+        if (bitsout != bitsin) {
+            test_fail(a, bitsout, bitsin);
+            return bitsout ^ bitsin;
+        }
+    }
+    // It didn't fail the second time. Still a fail, but all we have is
+    // the two CRCs.
+    test_fail(0, want.crc, got.crc);
+    return ram_word_mask;
+}
+
+uint32_t quick_test(uint32_t addr_size, uint32_t bits)
+{
+    uint32_t failed;
+    uint i;
+
+    // MATS+ on the zeros the init wrote: up(r0,w1) down(r1,w0)
+    status.bit = 0;
+    if (!march_element(addr_size, false, 5) || !march_element(addr_size, true, 6)) {
+        return job_cancelled() ? 1 : test_result.expected ^ test_result.actual;
+    }
+    test_begin(1);
+    for (i = 0; i < QUICK_PATTERNS; i++) {
+        failed = quick_pattern(addr_size, bits, i);
+        if (failed) return failed;
+    }
+    test_begin(10);
+    return switch_test(addr_size, bits);
+}
+
+// Phases of the Standard and Exhaustive profiles, in their default order.
+// Each one writes its own data, so they can run in any order.
+#define PHASE_SCHED 0x01      // Runs with the background refresh on
+#define PHASE_EXHAUSTIVE 0x02 // Only in the exhaustive profile
+#define PHASE_NIBBLE 0x04     // Only on nibble mode variants
+#define PHASE_PAGE 0x08       // Only with page mode, and not on nibble variants
+#define PHASE_CBR 0x10        // Only on chips with CAS-before-RAS refresh
+
+typedef struct {
+    uint8_t test;  // Index into ram_test_names
+    uint8_t flags;
+    uint32_t (*func)(uint32_t addr_size, uint32_t bits);
+} ram_phase_t;
+
+static const ram_phase_t ram_phases[] = {
+    {0, PHASE_SCHED, marchb_test},
+    {1, PHASE_SCHED, psrandom_test},
+    {10, PHASE_SCHED, switch_test},
+    {5, PHASE_SCHED | PHASE_NIBBLE, nibble_test},
+    {6, PHASE_SCHED | PHASE_EXHAUSTIVE | PHASE_PAGE, page_test},
+    {8, PHASE_SCHED | PHASE_EXHAUSTIVE | PHASE_PAGE, long_ras_test},
+    {9, PHASE_SCHED | PHASE_EXHAUSTIVE, npsf_test},
+    {2, 0, refresh_test},
+    {4, PHASE_CBR, cbr_test},
+    {7, PHASE_EXHAUSTIVE, hammer_test},
+};
+#define NUM_RAM_PHASES count_of(ram_phases)
+
+// Puts the phases that most often caught this chip type first. The sort is
+// stable, so phases that never caught anything keep the default order.
+static void ram_phase_order(uint chip, uint8_t *order)
+{
+    uint i, j;
+    uint8_t t;
+
+    for (i = 0; i < NUM_RAM_PHASES; i++) order[i] = i;
+    for (i = 1; i < NUM_RAM_PHASES; i++) {
+        t = order[i];
+        for (j = i; j > 0; j--) {
+            if (fail_stats_get(chip, ram_phases[order[j - 1]].test) >=
+                fail_stats_get(chip, ram_phases[t].test)) break;
+            order[j] = order[j - 1];
+        }
+        order[j] = t;
+    }
+}
+
+// Initial entry for the RAM test routines running
+// on the second CPU core.
+uint32_t all_ram_tests(uint32_t addr_size, uint32_t bits)
+{
+    const mem_chip_t *chip = chip_list[main_menu.sel_line];
+    bool nibble = chip->nibble_variants & (1 << variants_menu.sel_line);
+    bool exhaustive = (mode_menu.sel_line == MODE_EXHAUSTIVE);
+    uint8_t order[NUM_RAM_PHASES];
+    const ram_phase_t *ph;
+    uint i;
+    int failed;
+// Start the telemetry from a clean slate
+    pio_stats_reset(pio, sm);
+    refresh_sched_start(chip->refresh_ms * 1000);
+// Initialize RAM by performing n RAS cycles. The masks are left over from
+// the last run, or 0 after boot, so set them for an all-zeros fill.
+    ram_word_mask = (1 << bits) - 1;
+    ram_bit_mask = ram_word_mask;
+    test_begin(0);
+    if (!march_element(addr_size, false, 0)) return JOB_ABORTED;
+    if (mode_menu.sel_line == MODE_QUICK) return quick_test(addr_size, bits);
+    memset(&bank_report, 0, sizeof(bank_report));
+    if (chip->cycle_map->banks == 2) {
+        bank_probe(addr_size);
+    }
+// Now run actual tests, the likeliest to fail first
+    ram_phase_order(main_menu.sel_line, order);
+    for (i = 0; i < NUM_RAM_PHASES; i++) {
+        ph = &ram_phases[order[i]];
+        if ((ph->flags & PHASE_EXHAUSTIVE) && !exhaustive) continue;
+        if ((ph->flags & PHASE_NIBBLE) && !nibble) continue;
+        if ((ph->flags & PHASE_PAGE) && (!(chip->caps & MEM_CAP_PAGE) || nibble)) continue;
+        if ((ph->flags & PHASE_CBR) && !(chip->caps & MEM_CAP_CBR)) continue;
+        test_begin(ph->test);
+        refresh_sched_start((ph->flags & PHASE_SCHED) ? chip->refresh_ms * 1000 : 0);
+        // A phase that failed may have stopped part way through a word
+        psrand_bits_reset();
+        failed = ph->func(addr_size, bits);
+        if (failed && soak_running && !job_cancelled()) {
+            // Soak runs every phase. This one counts as failed even if it
+            // gave up without a bad read.
+            soak_report.run_phases |= 1u << ph->test;
+            soak_report.fail_mask |= failed;
+            continue;
+        }
+        if (failed) return failed;
+    }
+    return 0;
+}
+
+// Retention characterization. Every row group gets its own pause between
+// a RAS-only refresh and the read back, and a bisection per group narrows
+// down how long it holds its data. All groups share each pass, so a pass
+// costs one write, one read and the longest pause still being tried.
+#define RET_GROUPS 64
+#define RET_MAX_US 256000  // Longest pause we look for
+#define RET_PASSES 12      // Per pattern, at most
+#define RET_PATTERNS 3
+#define RET_BUCKETS 10     // <1ms, 1ms, 2ms, 4ms ... 128ms, 256ms+
+#define RET_WEAKEST 8
+
+static const char *ret_pattern_names[RET_PATTERNS] = {"zeros", "ones", "checker"};
+
+typedef struct {
+    uint16_t groups;
+    uint16_t group_rows;
+    uint32_t hold_us[RET_GROUPS];    // Longest pause the group survived with every pattern
+    uint8_t worst_pattern[RET_GROUPS];
+    uint16_t histogram[RET_BUCKETS];
+    uint8_t weakest[RET_WEAKEST];    // Group numbers, weakest first
+    uint32_t spec_us;
+} retention_report_t;
+
+// Written by core1 while the job runs, read by core0 once it's done
+static retention_report_t retention_report;
+
+// State of the pass in flight
+static uint32_t ret_target[RET_GROUPS];     // Pause we want for each group
+static uint32_t ret_release_at[RET_GROUPS]; // When its pause should start
+static uint32_t ret_refreshed[RET_GROUPS];  // When its pause did start
+static uint32_t ret_pause[RET_GROUPS];      // Pause it actually got
+static bool ret_released[RET_GROUPS];
+static bool ret_timed[RET_GROUPS];          // ret_refreshed is valid
+static bool ret_failed[RET_GROUPS];
+static uint32_t ret_keepalive_at;
+static uint32_t ret_keepalive_us;
+static uint32_t ret_slot_us;                // Time to read back one group
+
+static inline uint32_t ret_pattern(int pattern, int addr, uint row_bits)
+{
+    switch (pattern) {
+        case 0:
+            return 0;
+        case 1:
+            return ram_word_mask;
+        default:
+            return (((addr ^ (addr >> row_bits)) & 1) ? 0xaaaa : 0x5555) & ram_word_mask;
+    }
+}
+
+// RAS-only refreshes the groups whose pause starts now, and keeps the ones
+// still waiting for their turn alive. Released groups are left alone.
+static void ret_service()
+{
+    uint32_t now = time_us_32();
+    bool keepalive = (now - ret_keepalive_at) >= ret_keepalive_us;
+    uint rows = retention_report.group_rows;
+    bool busy = false;
+    uint g, r;
+
+    for (g = 0; g < retention_report.groups; g++) {
+        if (ret_released[g]) continue;
+        bool release = (int32_t)(now - ret_release_at[g]) >= 0;
+        if (!release && !keepalive) continue;
+        if (!busy) {
+            ram_cycle_begin();
+            busy = true;
+        }
+        for (r = g * rows; r < (g + 1) * rows; r++) {
+            ram_cycle_ras_only(r);
+        }
+        ret_released[g] = release;
+    }
+    if (!busy) return;
+    ram_cycle_end();
+    // Timed from the end of the burst, which errs towards a shorter pause
+    now = time_us_32();
+    if (keepalive) ret_keepalive_at = now;
+    for (g = 0; g < retention_report.groups; g++) {
+        if (ret_released[g] && !ret_timed[g]) {
+            ret_refreshed[g] = now;
+            ret_timed[g] = true;
+        }
+    }
+}
+
+// Reads a group back, one column at a time across its rows, so every row
+// ends its pause within a few accesses of the others
+static bool ret_verify_group(uint g, int pattern, uint32_t addr_size, uint *count)
+{
+    uint row_bits = chip_list[main_menu.sel_line]->row_bits;
+    uint rows = retention_report.group_rows;
+    uint col, r;
+    int a;
+
+    for (col = 0; col < (addr_size >> row_bits); col++) {
+        for (r = g * rows; r < (g + 1) * rows; r++) {
+            a = (col << row_bits) | r;
+            test_progress((*count)++);
+            if ((ram_read(a) & ram_word_mask) != ret_pattern(pattern, a, row_bits)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// One pass: write the pattern, give every group its pause, read it all back
+static bool ret_pass(uint32_t addr_size, int pattern)
+{
+    uint row_bits = chip_list[main_menu.sel_line]->row_bits;
+    uint32_t longest = 0;
+    uint32_t start, verify_at, t;
+    uint count = 0;
+    uint g;
+    int a;
+
+    pio_stats_begin(status.test, 0);
+    start = time_us_32();
+    for (a = 0; a < addr_size; a++) {
+        if (!test_progress(a)) {
+            pio_stats_end();
+            return false;
+        }
+        ram_write(a, ret_pattern(pattern, a, row_bits));
+    }
+    pio_stats_end();
+    // Reading is about as quick as writing, until we know better
+    if (ret_slot_us == 0) ret_slot_us = (time_us_32() - start) / retention_report.groups * 5 / 4;
+
+    // Group g is read back at verify_at + g * slot, so it is released that
+    // long minus its target pause beforehand
+    for (g = 0; g < retention_report.groups; g++) {
+        if (ret_target[g] > longest) longest = ret_target[g];
+    }
+    start = time_us_32();
+    verify_at = start + longest + ret_slot_us;
+    for (g = 0; g < retention_report.groups; g++) {
+        ret_release_at[g] = verify_at + g * ret_slot_us - ret_target[g];
+        ret_released[g] = false;
+        ret_timed[g] = false;
+    }
+    ret_keepalive_at = start - ret_keepalive_us;
+    TRACE(TRACE_REFRESH, TR_REFRESH_WAIT, longest, pattern);
+
+    pio_stats_begin(status.test, 1);
+    for (g = 0; g < retention_report.groups; g++) {
+        do {
+            ret_service();
+            if (job_cancelled()) {
+                pio_stats_end();
+                return false;
+            }
+        } while ((int32_t)(time_us_32() - (verify_at + g * ret_slot_us)) < 0);
+        t = time_us_32();
+        ret_pause[g] = t - ret_refreshed[g];
+        ret_failed[g] = !ret_verify_group(g, pattern, addr_size, &count);
+        t = time_us_32() - t;
+        // Don't let a slow read back eat into the next group's pause
+        if (t * 5 / 4 > ret_slot_us) ret_slot_us = t * 5 / 4;
+    }
+    pio_stats_end();
+    return true;
+}
+
+static uint ret_bucket(uint32_t us)
 {
-    int i;
-    psrand_seed(ARTISANAL_NUMBER);
-    for (i = 0; i < PSEUDO_VALUES; i++) {
-        random_seeds[i] = psrand_next();
+    uint bucket = 0;
+    uint32_t ms = us / 1000;
+    while (ms && (bucket < RET_BUCKETS - 1)) {
+        bucket++;
+        ms >>= 1;
     }
+    return bucket;
 }
 
-uint32_t psrand_next_bits(uint32_t bits)
+uint32_t retention_test(uint32_t addr_size, uint32_t bits)
 {
-    static int bitcount = 0;
-    static uint32_t cur_rand;
-    uint32_t out;
-
-    if (bitcount < bits) {
-        cur_rand = psrand_next();
-        bitcount = 32;
+    const mem_chip_t *chip = chip_list[main_menu.sel_line];
+    retention_report_t *rep = &retention_report;
+    uint32_t lo[RET_GROUPS], hi[RET_GROUPS];
+    bool taken[RET_GROUPS];
+    uint rows = 1 << chip->row_bits;
+    uint pattern, pass, g, i, open;
+    int best;
+
+    memset(rep, 0, sizeof(*rep));
+    rep->groups = (rows < RET_GROUPS) ? rows : RET_GROUPS;
+    rep->group_rows = rows / rep->groups;
+    rep->spec_us = chip->refresh_ms * 1000;
+    for (g = 0; g < rep->groups; g++) rep->hold_us[g] = UINT32_MAX;
+    ram_word_mask = (1 << bits) - 1;
+    ret_keepalive_us = rep->spec_us / 2;
+    ret_slot_us = 0;
+
+    refresh_sched_start(0);
+    test_begin(3);
+    for (pattern = 0; pattern < RET_PATTERNS; pattern++) {
+        // Everything starts out at the longest pause
+        for (g = 0; g < rep->groups; g++) {
+            lo[g] = 0;
+            hi[g] = UINT32_MAX;
+            ret_target[g] = RET_MAX_US;
+        }
+        for (pass = 0; pass < RET_PASSES; pass++) {
+            status.subtest = pattern;
+            if (!ret_pass(addr_size, pattern)) return JOB_ABORTED;
+
+            open = 0;
+            for (g = 0; g < rep->groups; g++) {
+                if (ret_failed[g]) {
+                    if (ret_pause[g] < hi[g]) hi[g] = ret_pause[g];
+                } else if (ret_pause[g] > lo[g]) {
+                    lo[g] = ret_pause[g];
+                }
+                // A shorter pause failed after a longer one held. That's
+                // noise, so settle on the pause that failed.
+                if (lo[g] > hi[g]) lo[g] = hi[g];
+                // Stop at about 6%, or when it held for the longest pause
+                if ((hi[g] != UINT32_MAX) && (hi[g] - lo[g] > hi[g] / 16)) {
+                    ret_target[g] = (lo[g] + hi[g]) / 2;
+                    open++;
+                } else {
+                    ret_target[g] = 0;
+                }
+            }
+            if (open == 0) break;
+        }
+        for (g = 0; g < rep->groups; g++) {
+            if (lo[g] < rep->hold_us[g]) {
+                rep->hold_us[g] = lo[g];
+                rep->worst_pattern[g] = pattern;
+            }
+        }
     }
 
-    out = cur_rand & ((1 << (bits)) - 1);
-    cur_rand = cur_rand >> bits;
-    bitcount -= bits;
-    return out;
+    // Histogram, and the weakest few groups by selection
+    for (g = 0; g < rep->groups; g++) {
+        rep->histogram[ret_bucket(rep->hold_us[g])]++;
+    }
+    memset(taken, 0, sizeof(taken));
+    for (i = 0; (i < RET_WEAKEST) && (i < rep->groups); i++) {
+        best = -1;
+        for (g = 0; g < rep->groups; g++) {
+            if (taken[g]) continue;
+            if ((best < 0) || (rep->hold_us[g] < rep->hold_us[best])) best = g;
+        }
+        taken[best] = true;
+        rep->weakest[i] = best;
+    }
+    return (rep->hold_us[rep->weakest[0]] < rep->spec_us) ? 1 : 0;
 }
 
+// Retention on its own
+uint32_t retention_job(uint32_t addr_size, uint32_t bits)
+{
+    pio_stats_reset(pio, sm);
+    return retention_test(addr_size, bits);
+}
 
-// Pseudorandom test
-uint32_t psrandom_test(uint32_t addr_size, uint32_t bits)
+// The exhaustive profile finishes with the retention map, if all else passed
+uint32_t exhaustive_tests(uint32_t addr_size, uint32_t bits)
 {
-    uint i;
-    uint32_t bitsout;
-    uint32_t bitsin;
-    uint32_t bitshift = addr_size / 4;
+    uint32_t failed;
 
-    // Write seeded pseudorandom data
-    for (i = 0; i < PSEUDO_VALUES; i++) {
-        stat_cur_subtest = i >> 2;
-        stat_cur_bit = i & 3;
-        psrand_seed(random_seeds[i]);
-        for (stat_cur_addr = 0; stat_cur_addr < addr_size; stat_cur_addr++) {
-            bitsout = psrand_next_bits(bits);
-            ram_write(stat_cur_addr, bitsout);
-        }
+    memset(&retention_report, 0, sizeof(retention_report));
+    failed = all_ram_tests(addr_size, bits);
+    if (failed || job_cancelled()) return failed;
+    return retention_test(addr_size, bits);
+}
 
-        // Reseed and then read the data back
-        psrand_seed(random_seeds[i]);
-        for (stat_cur_addr = 0; stat_cur_addr < addr_size; stat_cur_addr++) {
-            bitsout = psrand_next_bits(bits);
-            bitsin = ram_read(stat_cur_addr);
-            if (bitsout != bitsin) {
-                return 1;
+uint32_t soak_test(uint32_t addr_size, uint32_t bits)
+{
+    soak_report_t *rep = &soak_report;
+    test_result_t first;
+    uint32_t start, t;
+    uint phase;
+
+    memset(rep, 0, sizeof(*rep));
+    rep->min_us = UINT32_MAX;
+    rep->start_us = time_us_64();
+    soak_running = true;
+    while (!job_cancelled() && (!SOAK_ITERATIONS || (rep->iterations < SOAK_ITERATIONS))) {
+        test_result_reset();
+        rep->run_phases = 0;
+        start = time_us_32();
+        all_ram_tests(addr_size, bits);
+        // A run cut short by the stop button doesn't count
+        if (job_cancelled()) break;
+        t = time_us_32() - start;
+        rep->last_us = t;
+        if (t < rep->min_us) rep->min_us = t;
+        if (t > rep->max_us) rep->max_us = t;
+        // The init fill can't fail, so anything wrong is in run_phases
+        if (rep->run_phases) {
+            // Keep the first failing run for the result screen
+            if (rep->failed++ == 0) first = test_result;
+            for (phase = 0; phase < TEST_MAX_PHASES; phase++) {
+                if (rep->run_phases & (1u << phase)) rep->phase_fails[phase]++;
             }
         }
+        __dmb();
+        rep->iterations++;
     }
-
-    return 0;
+    soak_running = false;
+    if (rep->failed) test_result = first;
+    return rep->fail_mask;
 }
 
-uint32_t refresh_subtest(uint32_t addr_size, uint32_t bits, uint32_t time_delay)
+// Access time measurement. Rather than pass or fail at one sample point,
+// the wait before the read samples Q is cut a cycle at a time until reads
+// go bad, which finds the earliest point the data is stable. With tRCD at
+// its usual short value the read is held up by RAS#, so that gives tRAC.
+// With tRCD stretched as far as the delay field goes it's held up by CAS#
+// instead, which gives tCAC. Consecutive reads want opposite data, so a
+// sample taken before Q turns around fails. The input synchronizer is
+// bypassed for this, or every sample would land two cycles late.
+#define ACCESS_READS 1024   // Reads per pattern at each sample point
+#define ACCESS_STEP 0x9e37  // Odd, so every read goes to a different cell
+
+typedef struct {
+    bool valid;         // The chip has a sample point we know how to move
+    uint16_t rated_ns;  // From the speed grade name
+    uint16_t trac_ns;   // 0 if reads failed at the normal sample point
+    uint16_t tcac_ns;
+    bool trac_floor;    // Still good at the earliest point we can sample
+    bool tcac_floor;
+    bool tcac_skipped;  // Can't hold off CAS# past tRCD max at this grade
+} access_report_t;
+
+// Written by core1 while the job runs, read by core0 once it's done
+static access_report_t access_report;
+
+static inline int access_addr(uint32_t i, uint32_t addr_size)
 {
-    uint32_t bitsout;
-    uint32_t bitsin;
+    return (i * ACCESS_STEP) & (addr_size - 1);
+}
 
-    psrand_seed(random_seeds[0]);
-    for (stat_cur_addr = 0; stat_cur_addr < addr_size; stat_cur_addr++) {
-        bitsout = psrand_next_bits(bits);
-        ram_write(stat_cur_addr, bits);
-    }
+static inline uint32_t access_data(uint32_t i, uint pattern)
+{
+    return ((i ^ pattern) & 1) ? ram_word_mask : 0;
+}
 
-    sleep_us(time_delay);
+// Moves the sample trim cycles earlier. Only the wait after the address
+// is released gets cut, since the ones before it set tCAH and a failure
+// there could be a hold time violation rather than the access time.
+// Trim 0 puts the normal timing back.
+static void access_trim(const ram_sample_t *s, uint trim)
+{
+    ram_cycle_wait_idle(pio, sm);
+    pio_trim_delays(pio, offset, s->sample_field, trim);
+}
 
-    psrand_seed(random_seeds[0]);
-    for (stat_cur_addr = 0; stat_cur_addr < addr_size; stat_cur_addr++) {
-        bitsout = psrand_next_bits(bits);
-        bitsin = ram_read(stat_cur_addr);
-        if (bits != bitsin) {
-            return 1;
+// Writes at the normal timing, then reads back with the sample moved
+// earlier. Returns false on a bad read.
+static bool access_point(const ram_sample_t *s, uint32_t addr_size, uint32_t n, uint trim)
+{
+    uint pattern;
+    uint32_t i;
+    bool good = true;
+
+    for (pattern = 0; (pattern < 2) && good; pattern++) {
+        access_trim(s, 0);
+        for (i = 0; i < n; i++) {
+            if (!test_progress(i)) return false;
+            ram_write(access_addr(i, addr_size), access_data(i, pattern));
+        }
+        access_trim(s, trim);
+        for (i = 0; i < n; i++) {
+            if (!test_progress(i)) break;
+            if (ram_read(access_addr(i, addr_size)) != access_data(i, pattern)) {
+                good = false;
+                break;
+            }
         }
     }
-    return 0;
+    access_trim(s, 0);
+    return good && !job_cancelled();
 }
 
-
-uint32_t refresh_test(uint32_t addr_size, uint32_t bits)
+// Walks the sample point earlier until a read goes bad. Returns the
+// earliest good point in cycles after CAS# low, or 0 if even the normal
+// one failed. *floor is set if it was still good with the sample right
+// after the address release, which is as early as we can go.
+static uint access_sweep(const ram_sample_t *s, uint32_t addr_size, uint32_t n, bool *floor)
 {
-    return refresh_subtest(addr_size, bits, 5000);
-}
-
+    uint most = pio_field_delay(s->sample_field);
+    uint cas = 0;
+    uint trim;
+    uint8_t f;
 
-static const char *ram_test_names[] = {"March-B", "Pseudo", "Refresh"};
+    for (f = 0; f < 32; f++) {
+        if (s->cas_fields & (1u << f)) cas += pio_field_delay(f);
+    }
+    for (trim = 0; trim <= most; trim++) {
+        status.subtest = trim;
+        if (!access_point(s, addr_size, n, trim)) break;
+    }
+    *floor = (trim > most);
+    if (trim == 0) return 0;
+    return s->cas_cycles + cas - (trim - 1);
+}
 
-// Initial entry for the RAM test routines running
-// on the second CPU core.
-uint32_t all_ram_tests(uint32_t addr_size, uint32_t bits)
+uint32_t access_test(uint32_t addr_size, uint32_t bits)
 {
-    int failed;
-    int test = 0;
-// Initialize RAM by performing n RAS cycles
-    march_element(addr_size, false, 0);
-// Now run actual tests
-    queue_add_blocking(&stat_cur_test, &test);
-    failed = marchb_test(addr_size, bits);
-    if (failed) return failed;
-    test = 1;
-    queue_add_blocking(&stat_cur_test, &test);
-    failed = psrandom_test(addr_size, bits);
-    if (failed) return failed;
-    test = 2;
-    queue_add_blocking(&stat_cur_test, &test);
-    failed = refresh_test(addr_size, bits);
-    if (failed) return failed;
-    return 0;
+    const mem_chip_t *chip = chip_list[main_menu.sel_line];
+    const ram_sample_t *s = chip->sample;
+    access_report_t *rep = &access_report;
+    uint32_t n = (addr_size < ACCESS_READS) ? addr_size : ACCESS_READS;
+    uint32_t bypass;
+    uint pin = SOCKET_PIN_BASE;
+    uint rcd, cas;
+
+    memset(rep, 0, sizeof(*rep));
+    rep->rated_ns = atoi(chip->speed_names[speed_menu.sel_line]);
+    // The nibble program has a read path of its own
+    if ((s == NULL) || (chip->nibble_variants & (1 << variants_menu.sel_line))) return 1;
+    rep->valid = true;
+    ram_word_mask = (1 << bits) - 1;
+    rcd = pio_field_delay(s->rcd_field);
+
+    pio_stats_reset(pio, sm);
+    refresh_sched_start(chip->refresh_ms * 1000);
+    test_begin(11);
+    ram_cycle_wait_idle(pio, sm);
+    bypass = pio->input_sync_bypass;
+    hw_set_bits(&pio->input_sync_bypass, chip->q_pins << pin);
+
+    pio_stats_begin(status.test, 0);
+    cas = access_sweep(s, addr_size, n, &rep->trac_floor);
+    pio_stats_end();
+    if (cas) rep->trac_ns = (s->ras_cycles + rcd + cas) * 10 / 3;
+
+    // tCAC is measured with tRCD stretched as far as the delay field goes,
+    // so the read is limited by CAS# rather than RAS#. That only holds past
+    // tRCD max = tRAC - tCAC. tCAC is at least half of tRAC on these parts,
+    // so skip the grades where the stretch doesn't reach half of tRAC.
+    rep->tcac_skipped = ((s->ras_cycles + 31) * 10 / 3 < rep->rated_ns / 2);
+    if (!job_cancelled() && !rep->tcac_skipped) {
+        ram_cycle_wait_idle(pio, sm);
+        pio_set_delays(pio, offset, s->rcd_field, 31);
+        pio_stats_begin(status.test, 1);
+        cas = access_sweep(s, addr_size, n, &rep->tcac_floor);
+        pio_stats_end();
+        ram_cycle_wait_idle(pio, sm);
+        pio_trim_delays(pio, offset, s->rcd_field, 0);
+        if (cas) rep->tcac_ns = cas * 10 / 3;
+    }
+
+    pio->input_sync_bypass = bypass;
+    if (job_cancelled()) return JOB_ABORTED;
+    return ((rep->trac_ns == 0) || (rep->trac_ns > rep->rated_ns)) ? 1 : 0;
 }
 
 typedef struct {
@@ -454,6 +2468,67 @@ void show_speed_menu()
     gui_listbox(cur_menu, LIST_ACTION_NONE);
 }
 
+// Rough run time of a profile, in seconds. Counts the accesses each phase
+// makes per cell at about two tRAC each plus the trip through the FIFOs,
+// then adds the fixed waits. CBR and retention are taken at their longest.
+static uint32_t profile_seconds(const mem_chip_t *chip, uint profile, uint trac_ns)
+{
+    uint32_t width = __builtin_ctz(chip->mem_size);
+    uint32_t rows = 1 << chip->row_bits;
+    uint32_t per_cell, wait_ms;
+
+    // Init, MATS+, the CRC patterns and switching
+    per_cell = 1 + 4 + QUICK_PATTERNS * 2 + 4;
+    wait_ms = 0;
+    if (profile != MODE_QUICK) {
+        // Init, March-B per bit and per background, address orders,
+        // pseudorandom, switching and refresh
+        per_cell = 1 + 17 * (chip->bits + NUM_BACKGROUNDS - 1) + 5 * (width + 1) +
+                   (PSEUDO_VALUES + 1) * 2 + 4 + 2;
+        wait_ms = 5;
+        if (chip->caps & MEM_CAP_CBR) wait_ms += 3 * CBR_MAX_HOLD_MS;
+    }
+    if (profile == MODE_EXHAUSTIVE) {
+        if (chip->caps & MEM_CAP_PAGE) per_cell += 2 + 6;
+        per_cell += 1 + NPSF_PATTERNS * 6 / 5 + HAMMER_PATTERNS * 5;
+        // Each row is hammered for about half a refresh period
+        wait_ms += rows * HAMMER_PATTERNS * chip->refresh_ms / 2;
+        per_cell += RET_PATTERNS * RET_PASSES * 2;
+        wait_ms += RET_PATTERNS * RET_PASSES * (RET_MAX_US / 2000);
+    }
+    return (uint32_t)((uint64_t)per_cell * chip->mem_size * (2 * trac_ns + 150) / 1000000000u) +
+           (wait_ms + 999) / 1000;
+}
+
+void show_mode_menu()
+{
+    static char profile_text[MODE_EXHAUSTIVE + 1][24];
+    static char soak_text[24];
+    static const char *profile_names[MODE_EXHAUSTIVE + 1] = {"Quick", "Standard", "Exhaustive"};
+    const mem_chip_t *chip = chip_list[main_menu.sel_line];
+    uint trac_ns = atoi(chip->speed_names[speed_menu.sel_line]);
+    uint32_t t;
+    uint m;
+
+    // Profiles show how long they should take with this chip and grade
+    for (m = MODE_QUICK; m <= MODE_EXHAUSTIVE; m++) {
+        t = profile_seconds(chip, m, trac_ns);
+        if (t < 120) {
+            sprintf(profile_text[m], "%s ~%lus", profile_names[m], (unsigned long)t);
+        } else {
+            sprintf(profile_text[m], "%s ~%lum", profile_names[m], (unsigned long)(t + 30) / 60);
+        }
+        mode_menu_items[m] = profile_text[m];
+    }
+    // Soak repeats the standard profile
+    sprintf(soak_text, "Soak ~%lus/run",
+            (unsigned long)profile_seconds(chip, MODE_STANDARD, trac_ns));
+    mode_menu_items[MODE_SOAK] = soak_text;
+    cur_menu = &mode_menu;
+    paint_dialog("Select Test");
+    gui_listbox(cur_menu, LIST_ACTION_NONE);
+}
+
 
 #define CELL_STAT_X 9
 #define CELL_STAT_Y 33
@@ -509,8 +2584,9 @@ void show_test_gui()
         }
     }
     stat_old_addr = 0;
-    stat_cur_bit = 0;
-    stat_cur_subtest = 0;
+    stat_shown_test = -1;
+    stat_shown_runs = 0;
+    soak_report.iterations = 0;
 
     // Current test indicator
     paint_status(120, 35, 110, "      ");
@@ -518,26 +2594,273 @@ void show_test_gui()
     add_repeating_timer_ms(-100, drum_animation_cb, NULL, &drum_timer);
 }
 
+// Half-good parts (4108, 4132, 4408) are full size dies sold with one half
+// known to work. Which half is in the part number, but the markings vary
+// between makers, so run a short march over each half and pick the one
+// that holds up. Core1 is idle, so this goes straight to the chip
+// routines. Ties go to the variant picked in the menu.
+#define HALF_SCAN_MAX_FAILS 64  // Plenty to tell a bad half, and it stops early
+
+static uint32_t half_scan(const mem_chip_t *chip)
+{
+    uint32_t ones = (1 << chip->bits) - 1;
+    uint32_t fails = 0;
+    int a;
+
+    for (a = 0; a < chip->mem_size; a++) {
+        chip->ram_write(a, 0);
+    }
+    for (a = 0; (a < chip->mem_size) && (fails < HALF_SCAN_MAX_FAILS); a++) {
+        if (chip->ram_read(a) != 0) fails++;
+        chip->ram_write(a, ones);
+    }
+    for (a = chip->mem_size - 1; (a >= 0) && (fails < HALF_SCAN_MAX_FAILS); a--) {
+        if (chip->ram_read(a) != ones) fails++;
+        chip->ram_write(a, 0);
+    }
+    return fails;
+}
+
+static void half_detect(const mem_chip_t *chip)
+{
+    uint32_t fails[4];
+    uint best = variants_menu.sel_line;
+    uint v;
+
+    for (v = 0; (v < chip->variants->num_variants) && (v < count_of(fails)); v++) {
+        chip->setup_pio(speed_menu.sel_line, v);
+        fails[v] = half_scan(chip);
+        chip->teardown_pio();
+        printf("Half scan: %s %lu%s bad reads\n", chip->variants->variant_names[v],
+               (unsigned long)fails[v], (fails[v] >= HALF_SCAN_MAX_FAILS) ? "+" : "");
+    }
+    for (v = 0; (v < chip->variants->num_variants) && (v < count_of(fails)); v++) {
+        if (fails[v] < fails[best]) best = v;
+    }
+    if (best != variants_menu.sel_line) {
+        printf("Half scan: using %s\n", chip->variants->variant_names[best]);
+        variants_menu.sel_line = best;
+    }
+}
+
+// Chip identification for the Auto entry. The 4164 and 41256 share a
+// socket, and the x4 parts share another. Each family is probed with the
+// driver for its biggest part, looking for address lines the chip ignores:
+// cells that differ only in that line alias. A 4164 ignores A8, as does
+// the 4464, and the 4416 also ignores column A0. Slow parts that won't
+// run at the big part's slowest timing get a second try with their own
+// driver. The 1-bit socket goes first. While its program runs, the pad
+// pull-downs hold RAS#, CAS# and WE# low on the x4 socket, so a part there
+// sits in a write cycle and can't drive the shared lines.
+#define IDENT_CELLS 16
+
+// Writes a tag to a few cells and the inverted tag to the same cells with
+// alias_bit set, then reads the first ones back. Returns 1 if they were
+// overwritten, 0 if they kept their tag and -1 if they don't hold data.
+// An alias_bit of 0 just checks that there's a working chip.
+static int ident_probe(const mem_chip_t *chip, uint32_t alias_bit)
+{
+    uint32_t ones = (1 << chip->bits) - 1;
+    uint32_t tag, d;
+    uint kept = 0, lost = 0, i;
+    int a;
+
+    chip->setup_pio(chip->speed_grades - 1, 0);
+    // A few RAS# cycles to wake the chip up
+    for (i = 0; i < 8; i++) chip->ram_read(0);
+    for (i = 0; i < IDENT_CELLS; i++) {
+        a = (i * 0x1041) & (chip->mem_size - 1) & ~alias_bit;
+        tag = (i ^ (i >> 1)) & ones;
+        chip->ram_write(a, tag);
+        if (alias_bit) chip->ram_write(a | alias_bit, ~tag & ones);
+    }
+    for (i = 0; i < IDENT_CELLS; i++) {
+        a = (i * 0x1041) & (chip->mem_size - 1) & ~alias_bit;
+        tag = (i ^ (i >> 1)) & ones;
+        d = chip->ram_read(a);
+        if (d == tag) kept++;
+        if (d == (~tag & ones)) lost++;
+    }
+    chip->teardown_pio();
+    if (kept == IDENT_CELLS) return 0;
+    if (alias_bit && (lost == IDENT_CELLS)) return 1;
+    return -1;
+}
+
+// Returns the chip in the socket, or NULL if we can't tell. Core1 is idle,
+// so this goes straight to the chip routines.
+static const mem_chip_t *chip_identify()
+{
+    int r;
+
+    power_on();
+    r = ident_probe(&ram41256_chip, 1 << 8);         // Row A8
+    if (r >= 0) return r ? &ram4164_chip : &ram41256_chip;
+    if (ident_probe(&ram4164_chip, 0) == 0) return &ram4164_chip;
+
+    r = ident_probe(&ram44256_chip, 1 << 8);         // Row A8
+    if (r == 0) return &ram44256_chip;
+    if (r == 1) {
+        r = ident_probe(&ram44256_chip, 1 << 9);     // Column A0
+        return (r == 1) ? &ram4416_chip : &ram4464_chip;
+    }
+    r = ident_probe(&ram4464_chip, 1 << 8);          // Column A0
+    if (r >= 0) return r ? &ram4416_chip : &ram4464_chip;
+    if (ident_probe(&ram4416_chip, 0) == 0) return &ram4416_chip;
+    power_off();
+    return NULL;
+}
+
+// Selects whatever chip is in the socket for a full test at its slowest
+// speed grade. Returns false if there's no chip we know.
+static bool chip_auto_select()
+{
+    const mem_chip_t *chip = chip_identify();
+    uint i;
+
+    if (chip == NULL) {
+        printf("Auto: no chip found\n");
+        return false;
+    }
+    for (i = 0; i < NUM_CHIPS; i++) {
+        if (chip_list[i] == chip) main_menu.sel_line = i;
+    }
+    variants_menu.sel_line = 0;
+    speed_menu.sel_line = chip->speed_grades - 1;
+    mode_menu.sel_line = MODE_STANDARD;
+    printf("Auto: found %s\n", chip->chip_name);
+    return true;
+}
+
+// Presence check before a run. A few cells are written and read back with
+// the Q pads pulled down, then up. A working output reads against the pull
+// whenever the data says so. One that only ever reads what the pull says
+// isn't connected: the socket is empty, or a Q or DQ pin isn't making
+// contact. Reads that are driven but wrong point at a bent or badly seated
+// pin elsewhere. Takes about a millisecond.
+#define PRECHECK_CELLS 8
+#define PRECHECK_SETTLE_US 20  // For a floating pin to follow the pull
+
+static uint32_t precheck_data(const mem_chip_t *chip, uint pattern, uint i)
+{
+    uint32_t ones = (1 << chip->bits) - 1;
+    switch (pattern) {
+        case 0:
+            return (i & 1) ? ones : 0;
+        case 1:
+            return (i & 1) ? 0 : ones;
+        default:
+            return 1u << (i % chip->bits);  // Walking one, for shorted DQs
+    }
+}
+
+// Returns NULL if the chip looks fine, or what's wrong
+static const char *precheck(const mem_chip_t *chip)
+{
+    static char msg[16];
+    uint32_t ones = (1 << chip->bits) - 1;
+    uint32_t driven = 0, wrong = 0;
+    uint32_t pulled, d;
+    bool up_was[32], down_was[32];
+    uint pin = SOCKET_PIN_BASE;
+    uint i, b, up, pattern;
+
+    for (b = 0; b < 32; b++) {
+        if (!(chip->q_pins & (1u << b))) continue;
+        up_was[b] = gpio_is_pulled_up(pin + b);
+        down_was[b] = gpio_is_pulled_down(pin + b);
+    }
+    for (up = 0; up < 2; up++) {
+        pulled = up ? ones : 0;
+        for (b = 0; b < 32; b++) {
+            if (chip->q_pins & (1u << b)) gpio_set_pulls(pin + b, up, !up);
+        }
+        for (pattern = 0; pattern < 3; pattern++) {
+            for (i = 0; i < PRECHECK_CELLS; i++) {
+                chip->ram_write((i * 0x1041) & (chip->mem_size - 1),
+                                precheck_data(chip, pattern, i));
+            }
+            // The x4 programs only let go of DQ on a read, so do one first
+            chip->ram_read(0);
+            sleep_us(PRECHECK_SETTLE_US);
+            for (i = 0; i < PRECHECK_CELLS; i++) {
+                d = chip->ram_read((i * 0x1041) & (chip->mem_size - 1));
+                wrong |= d ^ precheck_data(chip, pattern, i);
+                driven |= d ^ pulled;
+            }
+        }
+    }
+    for (b = 0; b < 32; b++) {
+        if (chip->q_pins & (1u << b)) gpio_set_pulls(pin + b, up_was[b], down_was[b]);
+    }
+
+    if ((driven & ones) == 0) return "Empty socket";
+    if (~driven & ones) {
+        sprintf(msg, "DQ%d open", __builtin_ctz(~driven & ones));
+        return msg;
+    }
+    // Half-good parts may well read back wrong in the half we guessed
+    if ((wrong & ones) && !(chip->caps & MEM_CAP_HALF)) return "Bad contact";
+    return NULL;
+}
+
+void stop_the_ram_test();
+
+// Jobs for each entry of the mode menu
+static uint32_t (*const mode_jobs[NUM_MODES])(uint32_t, uint32_t) = {
+    all_ram_tests, all_ram_tests, exhaustive_tests, retention_job, access_test, soak_test
+};
+
 // Begins the RAM test with the selected RAM chip
 void start_the_ram_test()
 {
+    const char *msg;
+
     // Get the power turned on
     power_on();
 
     // Get the PIO going
-    chip_list[main_menu.sel_line]->setup_pio(speed_menu.sel_line, variants_menu.sel_line);
+    const mem_chip_t *chip = chip_list[main_menu.sel_line];
+    chip->setup_pio(speed_menu.sel_line, variants_menu.sel_line);
+    // Speed names all start with the access time in ns
+    ram_cycle_setup(chip, atoi(chip->speed_names[speed_menu.sel_line]));
+
+    // Don't start a run on an empty or badly seated socket
+    msg = precheck(chip);
+    if ((msg == NULL) && (chip->caps & MEM_CAP_HALF)) {
+        // Only now is it worth scanning for the good half. The scan loads
+        // each variant in turn, so start over with the one it picked.
+        ram_cycle_teardown();
+        chip->teardown_pio();
+        half_detect(chip);
+        chip->setup_pio(speed_menu.sel_line, variants_menu.sel_line);
+        ram_cycle_setup(chip, atoi(chip->speed_names[speed_menu.sel_line]));
+    }
+    if (msg != NULL) {
+        printf("Precheck: %s\n", msg);
+        stop_the_ram_test();
+        cancel_repeating_timer(&drum_timer);
+        st7789_fill(STATUS_ICON_X, STATUS_ICON_Y, 32, 32, COLOR_LTGRAY); // Erase icon
+        draw_icon(STATUS_ICON_X, STATUS_ICON_Y, &error_icon);
+        paint_status(120, 105, 110, (char *)msg);
+        gui_state = TEST_RESULTS;
+        return;
+    }
+
+    // Core1 is idle, so it's safe to start the progress channel and the
+    // trace rings over
+    status_reset(&status_chan);
+    trace_clear();
 
     // Dispatch the second core
     // (The memory size is from our memory description data structure)
-    queue_entry_t entry = {all_ram_tests,
-                           chip_list[main_menu.sel_line]->mem_size,
-                           chip_list[main_menu.sel_line]->bits};
-    queue_add_blocking(&call_queue, &entry);
+    job_dispatch(mode_jobs[mode_menu.sel_line], chip->mem_size, chip->bits);
 }
 
 // Stops the RAM test
 void stop_the_ram_test()
 {
+    ram_cycle_teardown();
     chip_list[main_menu.sel_line]->teardown_pio();
     power_off();
 }
@@ -557,13 +2880,13 @@ static inline void map_vis_dot(int addr, int ox, int oy, int bitsize, uint16_t c
 }
 
 // Draw up visualization from current test state
-void do_visualization()
+void do_visualization(const test_status_t *st)
 {
     const uint16_t cmap[] = {COLOR_DKBLUE, COLOR_DKGREEN, COLOR_DKMAGENTA, COLOR_DKYELLOW, COLOR_GREEN};
     int bitsize = chip_list[main_menu.sel_line]->bits;
-    int new_addr = stat_cur_addr * 1024 / chip_list[main_menu.sel_line]->mem_size / bitsize;
-    int bit = stat_cur_bit;
-    uint16_t col = cmap[stat_cur_subtest];
+    int new_addr = st->addr * 1024 / chip_list[main_menu.sel_line]->mem_size / bitsize;
+    int bit = st->bit;
+    uint16_t col = cmap[st->subtest % count_of(cmap)];
     int delta, i;
     int ox, oy = 0;
 
@@ -601,22 +2924,257 @@ void do_visualization()
     stat_old_addr = new_addr;
 }
 
+// Sends the result record out over USB
+static void test_result_print(const test_result_t *r)
+{
+    uint i;
+
+    printf("Result %08lx\n", (unsigned long)r->fail_mask);
+    if (r->fail_count) {
+        printf("First failure: %s element %d bit %d\n", ram_test_names[r->phase],
+               r->element, r->bit);
+        printf("  addr %05lx row %03lx col %03lx\n", (unsigned long)r->addr,
+               (unsigned long)r->row, (unsigned long)r->col);
+        printf("  expected %lx got %lx, %lu failing reads\n", (unsigned long)r->expected,
+               (unsigned long)r->actual, (unsigned long)r->fail_count);
+        printf("  seed %016llx\n", (unsigned long long)r->seed);
+    }
+    for (i = 0; i < count_of(ram_test_names); i++) {
+        printf("%-10s %lu us\n", ram_test_names[i], (unsigned long)r->phase_us[i]);
+    }
+    printf("Scheduled refresh: %lu rows\n", (unsigned long)r->refresh_rows);
+    if (r->phase_us[4]) {
+        printf("CBR hold %lu ms, %s\n", (unsigned long)cbr_report.hold_ms,
+               cbr_report.lost ? "counter verified" : "cells held without refresh, counter not proven");
+    }
+    if (r->phase_us[6]) {
+        printf("Page mode margin %d cycles (%d ns)%s\n", page_report.trim, page_report.trim * 33 / 10,
+               page_report.limited ? ", no failures before the delays ran out" : "");
+    }
+    if (r->phase_us[7]) {
+        hammer_report_print(&hammer_report);
+    }
+    if (bank_report.same_ns) {
+        printf("Bank timing: same bank %lu ns/read, %lu errors; alternating %lu ns/read, %lu errors\n",
+               (unsigned long)bank_report.same_ns, (unsigned long)bank_report.same_errors,
+               (unsigned long)bank_report.alt_ns, (unsigned long)bank_report.alt_errors);
+    }
+}
+
+// Replaces the cell map in the left pane with the first failure's details
+static void show_failure_details(const test_result_t *r)
+{
+    char line[24];
+    uint16_t y = CELL_STAT_Y + 2;
+
+    st7789_fill(CELL_STAT_X, CELL_STAT_Y, 96, 96, COLOR_BLACK);
+    font_string(CELL_STAT_X + 2, y, (char *)ram_test_names[r->phase], 255,
+                COLOR_RED, COLOR_BLACK, &sserif13, true);
+    y += sserif13.height;
+    sprintf(line, "Elem %d Bit %d", r->element, r->bit);
+    font_string(CELL_STAT_X + 2, y, line, 255, COLOR_WHITE, COLOR_BLACK, &sserif13, false);
+    y += sserif13.height;
+    sprintf(line, "Addr %05lX", (unsigned long)r->addr);
+    font_string(CELL_STAT_X + 2, y, line, 255, COLOR_WHITE, COLOR_BLACK, &sserif13, false);
+    y += sserif13.height;
+    sprintf(line, "R %03lX C %03lX", (unsigned long)r->row, (unsigned long)r->col);
+    font_string(CELL_STAT_X + 2, y, line, 255, COLOR_WHITE, COLOR_BLACK, &sserif13, false);
+    y += sserif13.height;
+    sprintf(line, "Exp %lX Got %lX", (unsigned long)r->expected, (unsigned long)r->actual);
+    font_string(CELL_STAT_X + 2, y, line, 255, COLOR_WHITE, COLOR_BLACK, &sserif13, false);
+    y += sserif13.height;
+    sprintf(line, "Fails %lu", (unsigned long)r->fail_count);
+    font_string(CELL_STAT_X + 2, y, line, 255, COLOR_WHITE, COLOR_BLACK, &sserif13, false);
+    y += sserif13.height;
+    if (r->seed) {
+        sprintf(line, "Seed %08lX", (unsigned long)(r->seed & 0xffffffff));
+        font_string(CELL_STAT_X + 2, y, line, 255, COLOR_WHITE, COLOR_BLACK, &sserif13, false);
+    }
+}
+
+static const char *ret_bucket_names[RET_BUCKETS] = {"<1ms", "1ms", "2ms", "4ms", "8ms",
+                                                   "16ms", "32ms", "64ms", "128ms", "256ms+"};
+
+// Sends the retention histogram and the weakest rows out over USB
+static void retention_report_print(const retention_report_t *rep)
+{
+    uint i, g;
+
+    printf("Retention, %d groups of %d rows, spec %lu us\n", rep->groups, rep->group_rows,
+           (unsigned long)rep->spec_us);
+    for (i = 0; i < RET_BUCKETS; i++) {
+        printf("%-7s %d\n", ret_bucket_names[i], rep->histogram[i]);
+    }
+    printf("Weakest rows:\n");
+    for (i = 0; (i < RET_WEAKEST) && (i < rep->groups); i++) {
+        g = rep->weakest[i];
+        printf("  rows %03x-%03x %lu us (%s)\n", g * rep->group_rows,
+               (g + 1) * rep->group_rows - 1, (unsigned long)rep->hold_us[g],
+               ret_pattern_names[rep->worst_pattern[g]]);
+    }
+}
+
+// Draws the retention histogram in the left pane, one bar per bucket
+static void show_retention(const retention_report_t *rep)
+{
+    uint16_t most = 1;
+    uint16_t h;
+    uint i;
+
+    st7789_fill(CELL_STAT_X, CELL_STAT_Y, 96, 96, COLOR_BLACK);
+    for (i = 0; i < RET_BUCKETS; i++) {
+        if (rep->histogram[i] > most) most = rep->histogram[i];
+    }
+    for (i = 0; i < RET_BUCKETS; i++) {
+        h = rep->histogram[i] * 90 / most;
+        if (rep->histogram[i] && (h == 0)) h = 1;
+        st7789_fill(CELL_STAT_X + 3 + i * 9, CELL_STAT_Y + 93 - h, 8, h,
+                    (rep->spec_us > (1000u << i) / 2) ? COLOR_RED : COLOR_GREEN);
+    }
+}
+
+// Sends the measured access times out over USB
+static void access_report_print(const access_report_t *rep)
+{
+    if (!rep->valid) {
+        printf("Access time: not supported for this chip\n");
+        return;
+    }
+    printf("Access time, rated %u ns\n", rep->rated_ns);
+    if (rep->trac_ns == 0) {
+        printf("  tRAC: reads fail at the normal sample point\n");
+    } else {
+        printf("  tRAC %s%u ns\n", rep->trac_floor ? "<" : "", rep->trac_ns);
+    }
+    if (rep->tcac_skipped) {
+        printf("  tCAC: not measured, tRCD can't be stretched far enough at this grade\n");
+    } else if (rep->tcac_ns == 0) {
+        printf("  tCAC: reads fail at the normal sample point\n");
+    } else {
+        printf("  tCAC %s%u ns\n", rep->tcac_floor ? "<" : "", rep->tcac_ns);
+    }
+}
+
+// Shows the measured access times in the left pane
+static void show_access(const access_report_t *rep)
+{
+    char line[24];
+    uint16_t y = CELL_STAT_Y + 2;
+
+    if (!rep->valid) return;
+    st7789_fill(CELL_STAT_X, CELL_STAT_Y, 96, 96, COLOR_BLACK);
+    sprintf(line, "Rated %uns", rep->rated_ns);
+    font_string(CELL_STAT_X + 2, y, line, 255, COLOR_WHITE, COLOR_BLACK, &sserif13, true);
+    y += sserif13.height;
+    if (rep->trac_ns) {
+        sprintf(line, "tRAC %s%uns", rep->trac_floor ? "<" : "", rep->trac_ns);
+    } else {
+        sprintf(line, "tRAC failed");
+    }
+    font_string(CELL_STAT_X + 2, y, line, 255,
+                (rep->trac_ns && (rep->trac_ns <= rep->rated_ns)) ? COLOR_GREEN : COLOR_RED,
+                COLOR_BLACK, &sserif13, false);
+    y += sserif13.height;
+    if (rep->tcac_skipped) {
+        sprintf(line, "tCAC n/a");
+    } else if (rep->tcac_ns) {
+        sprintf(line, "tCAC %s%uns", rep->tcac_floor ? "<" : "", rep->tcac_ns);
+    } else {
+        sprintf(line, "tCAC failed");
+    }
+    font_string(CELL_STAT_X + 2, y, line, 255, COLOR_WHITE, COLOR_BLACK, &sserif13, false);
+}
+
+static void soak_report_print(const soak_report_t *rep)
+{
+    uint i;
+
+    printf("Soak: %lu runs, %lu failed\n", (unsigned long)rep->iterations,
+           (unsigned long)rep->failed);
+    if (rep->iterations == 0) return;
+    printf("  run time last %lu us, min %lu us, max %lu us\n", (unsigned long)rep->last_us,
+           (unsigned long)rep->min_us, (unsigned long)rep->max_us);
+    for (i = 0; i < count_of(ram_test_names); i++) {
+        if (rep->phase_fails[i]) {
+            printf("  %-10s failed %lu\n", ram_test_names[i], (unsigned long)rep->phase_fails[i]);
+        }
+    }
+    // Union map of the bad cells over all runs
+    for (i = 0; i < rep->cells; i++) {
+        printf("  addr %06lx bits %lx in %lu/%lu runs\n", (unsigned long)rep->cell[i].addr,
+               (unsigned long)rep->cell[i].bits, (unsigned long)rep->cell[i].hits,
+               (unsigned long)rep->iterations);
+    }
+    if (rep->cells_lost) {
+        printf("  %lu bad reads at cells not listed\n", (unsigned long)rep->cells_lost);
+    }
+}
+
+static void show_soak(const soak_report_t *rep)
+{
+    char line[24];
+    uint16_t y = CELL_STAT_Y + 2;
+    uint i;
+
+    st7789_fill(CELL_STAT_X, CELL_STAT_Y, 96, 96, COLOR_BLACK);
+    sprintf(line, "Runs %lu", (unsigned long)rep->iterations);
+    font_string(CELL_STAT_X + 2, y, line, 255, COLOR_WHITE, COLOR_BLACK, &sserif13, true);
+    y += sserif13.height;
+    sprintf(line, "Failed %lu", (unsigned long)rep->failed);
+    font_string(CELL_STAT_X + 2, y, line, 255, rep->failed ? COLOR_RED : COLOR_GREEN,
+                COLOR_BLACK, &sserif13, false);
+    y += sserif13.height;
+    if (rep->iterations) {
+        sprintf(line, "%lu-%lus/run", (unsigned long)(rep->min_us / 1000000),
+                (unsigned long)((rep->max_us + 999999) / 1000000));
+        font_string(CELL_STAT_X + 2, y, line, 255, COLOR_WHITE, COLOR_BLACK, &sserif13, false);
+        y += sserif13.height;
+    }
+    // Phases that caught something, as many as fit
+    for (i = 0; (i < count_of(ram_test_names)) && (y + sserif13.height <= CELL_STAT_Y + 96); i++) {
+        if (rep->phase_fails[i] == 0) continue;
+        sprintf(line, "%s %lu", ram_test_names[i], (unsigned long)rep->phase_fails[i]);
+        font_string(CELL_STAT_X + 2, y, line, 255, COLOR_RED, COLOR_BLACK, &sserif13, false);
+        y += sserif13.height;
+    }
+}
+
+// Retention ran, on its own or at the end of the exhaustive profile
+static bool retention_ran()
+{
+    return (mode_menu.sel_line == MODE_RETENTION) ||
+           ((mode_menu.sel_line == MODE_EXHAUSTIVE) && retention_report.groups);
+}
+
 // During a RAM test, updates the status window and checks for the end of the test
 void do_status()
 {
     uint32_t retval;
+    test_result_t result;
     char retstring[30];
     uint16_t v;
     static uint16_t v_prev = 0;
-    int test;
+    test_status_t st;
+    uint64_t rate;
 
     if (gui_state == DO_TEST) {
-        do_visualization();
+        status_snapshot(&status_chan, &st);
+        do_visualization(&st);
 
         // Update the status text
-        if (queue_try_remove(&stat_cur_test, &test)) {
+        if ((st.test != stat_shown_test) && (st.test >= 0)) {
+            stat_shown_test = st.test;
             paint_status(120, 35, 110, "      ");
-            paint_status(120, 35, 110, (char *)ram_test_names[test]);
+            paint_status(120, 35, 110, (char *)ram_test_names[st.test]);
+        }
+
+        // Soak runs so far, and how many a minute
+        if ((mode_menu.sel_line == MODE_SOAK) && (soak_report.iterations != stat_shown_runs)) {
+            stat_shown_runs = soak_report.iterations;
+            rate = (uint64_t)stat_shown_runs * 600000000u / (time_us_64() - soak_report.start_us);
+            sprintf(retstring, "%lu runs %lu.%lu/min", (unsigned long)stat_shown_runs,
+                    (unsigned long)(rate / 10), (unsigned long)(rate % 10));
+            paint_status(120, 105, 110, retstring);
         }
 
         // Check official status
@@ -626,15 +3184,69 @@ void do_status()
             sleep_ms(10);
             // No more drums
             cancel_repeating_timer(&drum_timer);
-            queue_remove_blocking(&results_queue, &retval);
+            queue_remove_blocking(&results_queue, &result);
+            retval = result.fail_mask;
+            // The result record, per-phase timing and FIFO telemetry go out over USB
+            test_result_print(&result);
+            if (retention_ran() && (retval != JOB_ABORTED)) {
+                retention_report_print(&retention_report);
+            }
+            if ((mode_menu.sel_line == MODE_ACCESS) && (retval != JOB_ABORTED)) {
+                access_report_print(&access_report);
+            }
+            if (mode_menu.sel_line == MODE_SOAK) {
+                soak_report_print(&soak_report);
+            }
+            pio_stats_report(ram_test_names, count_of(ram_test_names));
+            // Count which phase caught a bad chip, for the fail-fast order.
+            // Phases that fail without a bad read are the one that ran last.
+            if ((mode_menu.sel_line <= MODE_EXHAUSTIVE) && retval && (retval != JOB_ABORTED)) {
+                status_snapshot(&status_chan, &st);
+                fail_stats_record(main_menu.sel_line, (result.phase >= 0) ? result.phase : st.test);
+                fail_stats_report(main_menu.sel_line, chip_list[main_menu.sel_line]->chip_name,
+                                  ram_test_names, count_of(ram_test_names));
+            }
+            TRACE(TRACE_GUI, TR_GUI_RESULT, retval, 0);
+            trace_dump();
             // Show the completion status
             gui_state = TEST_RESULTS;
             st7789_fill(STATUS_ICON_X, STATUS_ICON_Y, 32, 32, COLOR_LTGRAY); // Erase icon
-            if (retval == 0) {
+            if (retention_ran() && (retval != JOB_ABORTED)) {
+                show_retention(&retention_report);
+            }
+            if ((mode_menu.sel_line == MODE_ACCESS) && (retval != JOB_ABORTED)) {
+                show_access(&access_report);
+            }
+            // Stopping is the normal way out of a soak, so it has its own verdict
+            if (mode_menu.sel_line == MODE_SOAK) {
+                show_soak(&soak_report);
+                if (soak_report.failed) {
+                    draw_icon(STATUS_ICON_X, STATUS_ICON_Y, &error_icon);
+                    sprintf(retstring, "Failed %lu/%lu", (unsigned long)soak_report.failed,
+                            (unsigned long)soak_report.iterations);
+                } else if (soak_report.iterations) {
+                    draw_icon(STATUS_ICON_X, STATUS_ICON_Y, &check_icon);
+                    sprintf(retstring, "Passed %lu", (unsigned long)soak_report.iterations);
+                } else {
+                    draw_icon(STATUS_ICON_X, STATUS_ICON_Y, &warn_icon);
+                    sprintf(retstring, "Aborted");
+                }
+                paint_status(120, 105, 110, retstring);
+            } else if (retval == 0) {
                 paint_status(120, 35, 110, "Passed!");
                 draw_icon(STATUS_ICON_X, STATUS_ICON_Y, &check_icon);
+            } else if (retval == JOB_ABORTED) {
+                draw_icon(STATUS_ICON_X, STATUS_ICON_Y, &warn_icon);
+                paint_status(120, 105, 110, "Aborted");
+            } else if (retention_ran()) {
+                draw_icon(STATUS_ICON_X, STATUS_ICON_Y, &error_icon);
+                paint_status(120, 105, 110, "Weak rows");
+            } else if (mode_menu.sel_line == MODE_ACCESS) {
+                draw_icon(STATUS_ICON_X, STATUS_ICON_Y, &error_icon);
+                paint_status(120, 105, 110, access_report.valid ? "Too slow" : "Unsupported");
             } else {
                 draw_icon(STATUS_ICON_X, STATUS_ICON_Y, &error_icon);
+                if (result.fail_count) show_failure_details(&result);
                 if (chip_list[main_menu.sel_line]->bits == 4) {
                     sprintf(retstring, "Failed %d%d%d%d", (retval >> 3) & 1,
                                                            (retval >> 2) & 1,
@@ -652,9 +3264,18 @@ void do_status()
 // Called when user presses the action button
 void button_action()
 {
+    TRACE(TRACE_GUI, TR_GUI_ACTION, gui_state, 0);
     // Do something based on the current menu
     switch (gui_state) {
         case MAIN_MENU:
+            chip_auto = (main_menu.sel_line == NUM_CHIPS);
+            if (chip_auto) {
+                // The rest is up to the chip that turns up
+                gui_messagebox("Place Chip in Socket",
+                               "Turn on external supply afterwards, if used.", &chip_icon);
+                gui_state = DO_SOCKET;
+                break;
+            }
             // Check for variant
             if (chip_list[main_menu.sel_line]->variants == NULL) {
                 gui_state = SPEED_MENU;
@@ -670,11 +3291,20 @@ void button_action()
             show_speed_menu();
             break;
         case SPEED_MENU:
+            gui_state = MODE_MENU;
+            show_mode_menu();
+            break;
+        case MODE_MENU:
             gui_messagebox("Place Chip in Socket",
                            "Turn on external supply afterwards, if used.", &chip_icon);
             gui_state = DO_SOCKET;
             break;
         case DO_SOCKET:
+            if (chip_auto && !chip_auto_select()) {
+                gui_messagebox("No Chip Found", "Check the chip and its socket, then try again.",
+                               &warn_icon);
+                break;
+            }
             gui_state = DO_TEST;
             show_test_gui();
             start_the_ram_test();
@@ -682,7 +3312,14 @@ void button_action()
         case DO_TEST:
             break;
         case TEST_RESULTS:
-            // Quick retest to save time
+            // Quick retest to save time. Auto looks at the chip again, since
+            // it has probably been swapped.
+            if (chip_auto && !chip_auto_select()) {
+                gui_messagebox("No Chip Found", "Check the chip and its socket, then try again.",
+                               &warn_icon);
+                gui_state = DO_SOCKET;
+                break;
+            }
             gui_state = DO_TEST;
             show_test_gui();
             start_the_ram_test();
@@ -696,6 +3333,7 @@ void button_action()
 // Called when the user presses the back button
 void button_back()
 {
+    TRACE(TRACE_GUI, TR_GUI_BACK, gui_state, 0);
     switch (gui_state) {
         case MAIN_MENU:
             break;
@@ -713,15 +3351,35 @@ void button_back()
                 show_variant_menu();
             }
             break;
-        case DO_SOCKET:
+        case MODE_MENU:
             gui_state = SPEED_MENU;
             show_speed_menu();
             break;
+        case DO_SOCKET:
+            if (chip_auto) {
+                main_menu.sel_line = NUM_CHIPS;
+                gui_state = MAIN_MENU;
+                show_main_menu();
+                break;
+            }
+            gui_state = MODE_MENU;
+            show_mode_menu();
+            break;
         case DO_TEST:
+            // Core1 winds down within a few hundred accesses, and do_status
+            // tears down the PIO and power when its result arrives.
+            job_request_cancel();
+            paint_status(120, 105, 110, "Aborting");
             break;
         case TEST_RESULTS:
-            gui_state = SPEED_MENU;
-            show_speed_menu();
+            if (chip_auto) {
+                main_menu.sel_line = NUM_CHIPS;
+                gui_state = MAIN_MENU;
+                show_main_menu();
+                break;
+            }
+            gui_state = MODE_MENU;
+            show_mode_menu();
             break;
         default:
             gui_state = MAIN_MENU;
@@ -739,14 +3397,16 @@ void do_buttons()
 
 void wheel_increment()
 {
-    if (gui_state == MAIN_MENU || gui_state == SPEED_MENU || gui_state == VARIANT_MENU) {
+    if (gui_state == MAIN_MENU || gui_state == SPEED_MENU || gui_state == VARIANT_MENU ||
+        gui_state == MODE_MENU) {
         gui_listbox(cur_menu, LIST_ACTION_DOWN);
     }
 }
 
 void wheel_decrement()
 {
-    if (gui_state == MAIN_MENU || gui_state == SPEED_MENU || gui_state == VARIANT_MENU) {
+    if (gui_state == MAIN_MENU || gui_state == SPEED_MENU || gui_state == VARIANT_MENU ||
+        gui_state == MODE_MENU) {
         gui_listbox(cur_menu, LIST_ACTION_UP);
     }
 }
@@ -822,7 +3482,9 @@ int main() {
     //gpio_set_dir(15, GPIO_OUT);
 
     //printf("Test.\n");
+    stdio_init_all();
     psrand_init_seeds();
+    fail_stats_load();
 
     gpio_init(GPIO_LED);
     gpio_set_dir(GPIO_LED, GPIO_OUT);
@@ -833,8 +3495,7 @@ int main() {
 
     // Set up second core
     queue_init(&call_queue, sizeof(queue_entry_t), 2);
-    queue_init(&results_queue, sizeof(int32_t), 2);
-    queue_init(&stat_cur_test, sizeof(int), 2);
+    queue_init(&results_queue, sizeof(test_result_t), 2);
 
     // Second core will wait for the call queue.
     multicore_launch_core1(core1_entry);
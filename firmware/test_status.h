@@ -0,0 +1,67 @@
+#ifndef TEST_STATUS_H
+#define TEST_STATUS_H
+
+// Progress channel from the test core (core1) to the GUI core (core0).
+// This is a sequence lock with a single writer: core1 bumps the sequence
+// to an odd value, updates the record, then bumps it to even again.
+// Core0 retries its copy until it reads the same even sequence on both
+// sides, so it never sees a torn record and core1 never waits.
+
+// Core1 publishes once every (mask + 1) accesses
+#define STATUS_PUBLISH_MASK 0xff
+
+typedef struct {
+    int test;    // Index of the running test, -1 before the first one starts
+    int subtest; // March element or pattern group
+    int bit;     // Data bit under test
+    int addr;    // Most recent address
+} test_status_t;
+
+typedef struct {
+    volatile uint32_t seq;
+    volatile int test;
+    volatile int subtest;
+    volatile int bit;
+    volatile int addr;
+} status_channel_t;
+
+// Only call this while core1 is idle
+static inline void status_reset(status_channel_t *ch)
+{
+    ch->seq = 0;
+    ch->test = -1;
+    ch->subtest = 0;
+    ch->bit = 0;
+    ch->addr = 0;
+}
+
+// Writer side (core1)
+static inline void status_publish(status_channel_t *ch, const test_status_t *st)
+{
+    uint32_t seq = ch->seq;
+    ch->seq = seq + 1;
+    __dmb();
+    ch->test = st->test;
+    ch->subtest = st->subtest;
+    ch->bit = st->bit;
+    ch->addr = st->addr;
+    __dmb();
+    ch->seq = seq + 2;
+}
+
+// Reader side (core0)
+static inline void status_snapshot(status_channel_t *ch, test_status_t *st)
+{
+    uint32_t seq;
+    do {
+        seq = ch->seq;
+        __dmb();
+        st->test = ch->test;
+        st->subtest = ch->subtest;
+        st->bit = ch->bit;
+        st->addr = ch->addr;
+        __dmb();
+    } while ((seq & 1) || (seq != ch->seq));
+}
+
+#endif
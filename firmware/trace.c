@@ -0,0 +1,41 @@
+// Trace ring buffers
+
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "trace.h"
+
+trace_rec_t trace_ring[2][TRACE_RING_SIZE];
+uint32_t trace_head[2];
+
+static const char *trace_names[TR_EVENT_COUNT] = {
+    "march", "march-fail", "access", "ps-pattern", "ps-fail", "rf-write",
+    "rf-wait", "rf-fail", "rf-inject", "c1-start", "c1-done", "gui-action", "gui-back",
+    "gui-result" };
+
+// Empties both rings. Only call this while the other core is idle.
+void trace_clear()
+{
+    trace_head[0] = 0;
+    trace_head[1] = 0;
+}
+
+// Dumps both rings, oldest record first, over stdio.
+// Only call this while the other core is idle.
+void trace_dump()
+{
+    uint core;
+    uint32_t i, start;
+    trace_rec_t *rec;
+
+    if (TRACE_MASK == 0) return;
+    for (core = 0; core < 2; core++) {
+        start = (trace_head[core] > TRACE_RING_SIZE) ? trace_head[core] - TRACE_RING_SIZE : 0;
+        printf("Trace core%d: %lu events\n", core, (unsigned long)trace_head[core]);
+        for (i = start; i != trace_head[core]; i++) {
+            rec = &trace_ring[core][i & (TRACE_RING_SIZE - 1)];
+            printf("%10lu %-10s %08lx %08lx\n", (unsigned long)rec->time,
+                   (rec->id < TR_EVENT_COUNT) ? trace_names[rec->id] : "?",
+                   (unsigned long)rec->arg0, (unsigned long)rec->arg1);
+        }
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "pico/stdlib.h"
+
+// Lightweight tracepoints. Each core writes fixed-size records into its own
+// SRAM ring, so no locking is needed. The rings are dumped after a run.
+
+// Trace subsystems
+#define TRACE_MARCH   0 // March element boundaries and failures
+#define TRACE_PSRAND  1 // Pseudorandom patterns and failures
+#define TRACE_REFRESH 2 // Refresh test
+#define TRACE_CORE1   3 // Core1 job dispatcher
+#define TRACE_GUI     4 // GUI state machine
+#define TRACE_ACCESS  5 // Every single march access (fills the ring quickly)
+
+// Subsystems compiled in. None by default, so nothing is traced or dumped
+// unless picked from CMake, e.g. TRACE_MASK=0x3f.
+#ifndef TRACE_MASK
+#define TRACE_MASK 0
+#endif
+
+// Records per core. Must be a power of two.
+#define TRACE_RING_SIZE 256
+
+typedef enum {
+    TR_MARCH_ELEMENT,   // algorithm, descending
+    TR_MARCH_FAIL,      // address, bit mask
+    TR_ACCESS,          // address, algorithm
+    TR_PSRAND_PATTERN,  // pattern number, low word of seed
+    TR_PSRAND_FAIL,     // address, (expected << 16) | actual
+    TR_REFRESH_WRITE,   // address size, bits
+    TR_REFRESH_WAIT,    // delay in us
+    TR_REFRESH_FAIL,    // address, (expected << 16) | actual
+    TR_REFRESH_INJECT,  // rows refreshed by the scheduler so far
+    TR_CORE1_START,     // data, data2
+    TR_CORE1_DONE,      // result
+    TR_GUI_ACTION,      // gui state
+    TR_GUI_BACK,        // gui state
+    TR_GUI_RESULT,      // result
+    TR_EVENT_COUNT
+} trace_event_t;
+
+typedef struct {
+    uint32_t time; // Low word of the microsecond timer
+    uint32_t id;
+    uint32_t arg0;
+    uint32_t arg1;
+} trace_rec_t;
+
+extern trace_rec_t trace_ring[2][TRACE_RING_SIZE];
+extern uint32_t trace_head[2];
+
+void trace_clear();
+void trace_dump();
+
+static inline void trace_write(uint32_t id, uint32_t arg0, uint32_t arg1)
+{
+    uint core = get_core_num();
+    trace_rec_t *rec = &trace_ring[core][trace_head[core] & (TRACE_RING_SIZE - 1)];
+    rec->time = time_us_32();
+    rec->id = id;
+    rec->arg0 = arg0;
+    rec->arg1 = arg1;
+    trace_head[core]++;
+}
+
+// Compiles to nothing when the subsystem isn't selected
+#define TRACE(sys, id, arg0, arg1) \
+    do { if (TRACE_MASK & (1u << (sys))) trace_write((id), (arg0), (arg1)); } while (0)
+
+#endif